@@ -3,7 +3,11 @@
  *
  *  Created on: Oct 26, 2014
  *  Author: Ahmed Talaat (aa_talaat@yahoo.com)
- * TIM4 is configured to generate a 20ms interrupt to use it as a debounce delay
+ * TIM4 is used as the debounce delay of the keypads.
+ *
+ * The counter runs at 1 kHz and each keypad uses its own capture/compare channel (keypad id 0 uses CC1, ... up to 4
+ * keypads): arming the debounce of a keypad sets its compare register 20 counts ahead of the counter, so the keypads
+ * debounce independently of each other, each with its own delay. The counter only runs while at least one keypad is being debounced.
  *
  */
 
@@ -12,8 +16,10 @@
 
 /* Private function prototypes -----------------------------------------------*/
 
+static const uint16_t debounceIT[4] = {TIM_IT_CC1, TIM_IT_CC2, TIM_IT_CC3, TIM_IT_CC4};
+
 /*
- * TIM4 configures to generate an interrupt each 20ms
+ * TIM4 configures as a free running 1 kHz counter
  *
  */
 
@@ -33,10 +39,10 @@ TIM_TimeBaseInitTypeDef TIM_TimeBaseInitStruct;
 
     /* Time base configuration */
 
-    // TIM2 frequency = counter clock / (period + 1) = 1000 / (19+1) = 50 Hz --> 20ms
+    // Counter clock = 1000 Hz, the compare channels are set DEBOUNCE_MS counts ahead of the counter --> 20ms
     // Prescaler = (SystemCoreClock / Fx) - 1 where FX is the timer clock we want to use
 
-    TIM_TimeBaseInitStruct.TIM_Period = 19;
+    TIM_TimeBaseInitStruct.TIM_Period = 0xFFFF;
     TIM_TimeBaseInitStruct.TIM_Prescaler = (uint16_t) (SystemCoreClock / 1000) - 1;
     TIM_TimeBaseInitStruct.TIM_ClockDivision = 0;
     TIM_TimeBaseInitStruct.TIM_CounterMode = TIM_CounterMode_Up;
@@ -45,21 +51,42 @@ TIM_TimeBaseInitTypeDef TIM_TimeBaseInitStruct;
 }
 
 /*
- * Loads the timer with a 10ms debouce delay, and configure it to generate an interrupt once expired
+ * Loads the compare channel of a keypad with the debounce delay (DEBOUNCE_MS, or the adaptive delay of the column, see
+ * debounce.c), and configure it to generate an interrupt once expired
  */
-void enableDebounceTimer(void) {
-    /* TIM4 enable counter */
-	TIM_SetCounter(TIM4,0);							// Reset its counter
-	TIM_ITConfig(TIM4, TIM_IT_Update, ENABLE);		// Enable TIM Interrupt
-    TIM_Cmd(TIM4, ENABLE);							// Enable Timer
+void enableDebounceTimer(uint8_t channel, uint8_t delayMs) {
+	uint16_t	expiry = TIM_GetCounter(TIM4) + delayMs;
+	uint32_t	primask;
+
+	switch (channel) {
+		case 0:	TIM_SetCompare1(TIM4, expiry);	break;
+		case 1:	TIM_SetCompare2(TIM4, expiry);	break;
+		case 2:	TIM_SetCompare3(TIM4, expiry);	break;
+		case 3:	TIM_SetCompare4(TIM4, expiry);	break;
+		default: return;
+	}
+	TIM_ClearITPendingBit(TIM4, debounceIT[channel]);
+	primask = __get_PRIMASK();							// DIER and CR1 are shared with the other channels, and
+	__disable_irq();									// updated from ISRs of different priorities
+	TIM_ITConfig(TIM4, debounceIT[channel], ENABLE);	// Enable TIM Interrupt
+    TIM_Cmd(TIM4, ENABLE);								// Enable Timer (no effect if already running)
+	__set_PRIMASK(primask);
 }
 
 /*
- * Disable timer, and clear all interrupts
+ * Disable the channel interrupt, and clear its flag. The timer is stopped when no other keypad is being debounced.
  */
-void disableDebounceTimer(void) {
-    TIM_Cmd(TIM4, DISABLE);							// Disable Timer
-    TIM_ITConfig(TIM4, TIM_IT_Update, DISABLE);		// Disable TIM Interrupt
-	TIM_SetCounter(TIM4,0);							// Reset its counter
-	TIM_ClearITPendingBit(TIM4, TIM_IT_Update);		// Clear any pending interrupt bit so that we do not come here again
+void disableDebounceTimer(uint8_t channel) {
+	uint32_t	primask;
+
+	primask = __get_PRIMASK();
+	__disable_irq();
+	TIM_ITConfig(TIM4, debounceIT[channel], DISABLE);	// Disable TIM Interrupt
+	TIM_ClearITPendingBit(TIM4, debounceIT[channel]);	// Clear any pending interrupt bit so that we do not come here again
+	if (!(TIM4->DIER & DEBOUNCE_IT_ALL)) {
+	    TIM_Cmd(TIM4, DISABLE);							// Disable Timer
+		TIM_SetCounter(TIM4,0);							// Reset its counter
+	}
+	__set_PRIMASK(primask);
 }
+
@@ -8,8 +8,11 @@
 #ifndef TIM4_CH1_H_
 #define TIM4_CH1_H_
 
+#define DEBOUNCE_MS		20				// debounce delay, in TIM4 counts (1 kHz), longest one in the adaptive mode
+#define DEBOUNCE_IT_ALL	(TIM_IT_CC1 | TIM_IT_CC2 | TIM_IT_CC3 | TIM_IT_CC4)
+
 void TIM4_Configuration (void);
-void enableDebounceTimer(void);
-void disableDebounceTimer(void);
+void enableDebounceTimer(uint8_t channel, uint8_t delayMs);
+void disableDebounceTimer(uint8_t channel);
 
 #endif /* TIM4_CH1_H_ */
@@ -0,0 +1,102 @@
+/*
+ * adc_keypad.c
+ *
+ *  Author: Ahmed Talaat (aa_talaat@yahoo.com)
+ *
+ * Alternative input engine for the single pin resistor-ladder keypads (build with KEYPAD_ENGINE_ADC defined).
+ * It replaces the 8 pins matrix, the EXTI lines and the TIM4 debounce timer of buttons.c:
+ *	- TIM3 update event triggers one ADC1 conversion of LADDER_ADC_CHANNEL every 1 ms.
+ *	- DMA1 channel 1 stores the conversions in a circular buffer of ADC_KEYPAD_BUFFER_SIZE samples.
+ *	- The DMA half transfer and transfer complete interrupts hand each half of the buffer over to processLadderSamples()
+ *	  (ladder.c), which classifies, debounces and posts MSG_BT_DOWN/MSG_BT_UP into IsrToMainQueue.
+ *
+ * The ADC needs its clock, so the main loop sleeps (WFI) instead of going into STOP mode with this engine.
+ */
+
+#include "stm32f10x.h"
+#include "adc_keypad.h"
+#include "ladder.h"
+#include "gpio.h"
+#include "keymap.h"
+
+static uint16_t	adcSamples[ADC_KEYPAD_BUFFER_SIZE];
+
+/*
+ * Configure TIM3 as sampling clock, ADC1 triggered by TIM3 TRGO, and DMA1 channel 1 in circular mode
+ */
+void ADCKeypad_Configuration(void) {
+	TIM_TimeBaseInitTypeDef	TIM_TimeBaseInitStruct;
+	ADC_InitTypeDef			ADC_InitStructure;
+	DMA_InitTypeDef			DMA_InitStructure;
+	NVIC_InitTypeDef		NVIC_InitStructure;
+
+	initializeLadder(&ladderState, keymaps[0].keyMap);	// the ladder is keypad 0 for the layers
+
+	RCC_ADCCLKConfig(RCC_PCLK2_Div2);
+	RCC_AHBPeriphClockCmd(RCC_AHBPeriph_DMA1, ENABLE);
+	RCC_APB2PeriphClockCmd(RCC_APB2Periph_ADC1, ENABLE);
+	RCC_APB1PeriphClockCmd(RCC_APB1Periph_TIM3, ENABLE);
+
+	GPIO_ConfigLadder();
+
+	/* DMA: ADC1->DR to adcSamples, circular, half and full transfer interrupts */
+	DMA_DeInit(DMA1_Channel1);
+	DMA_InitStructure.DMA_PeripheralBaseAddr = (uint32_t) &ADC1->DR;
+	DMA_InitStructure.DMA_MemoryBaseAddr = (uint32_t) adcSamples;
+	DMA_InitStructure.DMA_DIR = DMA_DIR_PeripheralSRC;
+	DMA_InitStructure.DMA_BufferSize = ADC_KEYPAD_BUFFER_SIZE;
+	DMA_InitStructure.DMA_PeripheralInc = DMA_PeripheralInc_Disable;
+	DMA_InitStructure.DMA_MemoryInc = DMA_MemoryInc_Enable;
+	DMA_InitStructure.DMA_PeripheralDataSize = DMA_PeripheralDataSize_HalfWord;
+	DMA_InitStructure.DMA_MemoryDataSize = DMA_MemoryDataSize_HalfWord;
+	DMA_InitStructure.DMA_Mode = DMA_Mode_Circular;
+	DMA_InitStructure.DMA_Priority = DMA_Priority_Medium;
+	DMA_InitStructure.DMA_M2M = DMA_M2M_Disable;
+	DMA_Init(DMA1_Channel1, &DMA_InitStructure);
+	DMA_ITConfig(DMA1_Channel1, DMA_IT_HT | DMA_IT_TC, ENABLE);
+
+	/* Same priority as the matrix keypad debounce timer */
+	NVIC_InitStructure.NVIC_IRQChannel = DMA1_Channel1_IRQn;
+	NVIC_InitStructure.NVIC_IRQChannelPreemptionPriority = 0;
+	NVIC_InitStructure.NVIC_IRQChannelSubPriority = 1;
+	NVIC_InitStructure.NVIC_IRQChannelCmd = ENABLE;
+	NVIC_Init(&NVIC_InitStructure);
+
+	DMA_Cmd(DMA1_Channel1, ENABLE);
+
+	/* ADC: single channel, one conversion per external trigger */
+	ADC_InitStructure.ADC_Mode = ADC_Mode_Independent;
+	ADC_InitStructure.ADC_ScanConvMode = DISABLE;
+	ADC_InitStructure.ADC_ContinuousConvMode = DISABLE;
+	ADC_InitStructure.ADC_ExternalTrigConv = ADC_ExternalTrigConv_T3_TRGO;
+	ADC_InitStructure.ADC_DataAlign = ADC_DataAlign_Right;
+	ADC_InitStructure.ADC_NbrOfChannel = 1;
+	ADC_Init(ADC1, &ADC_InitStructure);
+	ADC_RegularChannelConfig(ADC1, LADDER_ADC_CHANNEL, 1, ADC_SampleTime_239Cycles5);
+	ADC_DMACmd(ADC1, ENABLE);
+	ADC_Cmd(ADC1, ENABLE);
+
+	ADC_ResetCalibration(ADC1);
+	while (ADC_GetResetCalibrationStatus(ADC1)) {}
+	ADC_StartCalibration(ADC1);
+	while (ADC_GetCalibrationStatus(ADC1)) {}
+
+	ADC_ExternalTrigConvCmd(ADC1, ENABLE);
+
+	/* TIM3: 1 MHz counter clock, update (TRGO) every 1000 counts */
+	TIM_TimeBaseInitStruct.TIM_Period = (1000000 / ADC_KEYPAD_SAMPLE_RATE) - 1;
+	TIM_TimeBaseInitStruct.TIM_Prescaler = (uint16_t) (SystemCoreClock / 1000000) - 1;
+	TIM_TimeBaseInitStruct.TIM_ClockDivision = 0;
+	TIM_TimeBaseInitStruct.TIM_CounterMode = TIM_CounterMode_Up;
+	TIM_TimeBaseInit(TIM3, &TIM_TimeBaseInitStruct);
+	TIM_SelectOutputTrigger(TIM3, TIM_TRGOSource_Update);
+	TIM_Cmd(TIM3, ENABLE);
+}
+
+/*
+ * Called from the DMA ISR with the half of the buffer that the DMA has just completed. The DMA is now writing into
+ * the other half, so there is half a buffer period (8 ms) to process it.
+ */
+void ADCKeypad_ProcessHalf(uint8_t secondHalf) {
+	processLadderSamples(&ladderState, &adcSamples[secondHalf ? ADC_KEYPAD_BUFFER_SIZE/2 : 0], ADC_KEYPAD_BUFFER_SIZE/2);
+}
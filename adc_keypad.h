@@ -0,0 +1,16 @@
+/*
+ * adc_keypad.h
+ *
+ *  Author: Ahmed Talaat (aa_talaat@yahoo.com)
+ */
+
+#ifndef ADC_KEYPAD_H_
+#define ADC_KEYPAD_H_
+
+#define ADC_KEYPAD_SAMPLE_RATE		1000	// Hz, one conversion per TIM3 update
+#define ADC_KEYPAD_BUFFER_SIZE		16		// DMA circular buffer, each half is processed by the DMA ISR (8 ms)
+
+void ADCKeypad_Configuration(void);
+void ADCKeypad_ProcessHalf(uint8_t secondHalf);
+
+#endif /* ADC_KEYPAD_H_ */
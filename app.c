@@ -0,0 +1,157 @@
+/*
+ * app.c
+ *
+ *  Author: Ahmed Talaat (aa_talaat@yahoo.com)
+ *
+ * The application run by the main loop of main.c: the setup of the peripherals and modules once the clocks are
+ * configured, the message handlers of the LEDs and of the power request (dispatch_table.h), and the key sequence flows.
+ *
+ * Kept out of main.c so that the host simulations (host/firmware.c) run the same setup, handlers and flows as the
+ * target, main.c only holding what cannot run on the host: the clocks, the NVIC and the main loop itself.
+ */
+
+#include "stm32f10x.h"
+#include "gpio.h"
+#include "TIM4.h"
+#include "buttons.h"
+#include "uart.h"
+#include "keymap.h"
+#include "dispatch.h"
+#include "flow.h"
+#include "storm.h"
+#include "wakeup.h"
+#include "app.h"
+#ifdef KEYPAD_ENGINE_ADC
+#include "adc_keypad.h"
+#endif
+
+#define PIN_KEY_TIMEOUT_MS		5000	// max time between two digits of the password
+#define LAYOUT_KEY_TIMEOUT_MS	1000	// max time between * and # to switch the layout
+
+typedef struct {
+	flow_t	flow;
+	uint8_t	index;						// digits of the password matched so far
+} pinFlow_t;
+
+typedef struct {
+	flow_t	flow;
+	uint8_t	deviceID;					// keypad on which * was pressed
+} layoutFlow_t;
+
+uint8_t	lowPowerRequest = 0;
+
+static const uint8_t pinCode[4] = {'1', '2', '3', '4'};
+
+static uint8_t pinFlow(flow_t *f);
+static uint8_t layoutFlow(flow_t *f);
+
+/*
+ * Everything main() sets up after the system clock and the NVIC
+ */
+void App_Init(void) {
+	lowPowerRequest = 0;
+#ifndef KEYPAD_ENGINE_ADC
+	TIM4_Configuration ();				// Configure the debounce timer
+#endif
+	GPIO_SetAllAnalogInput();			// change all IOs into Analog INP to save power
+	GPIO_ConfigDiscoveryLEDs();			// Debug using Discovery 2 LEDs
+	UART_Configuration();				// Stream the key events to the host
+	Keymap_Init();						// Default layers, only the base layer active
+#ifdef KEYPAD_ENGINE_ADC
+	ADCKeypad_Configuration();			// Sample the resistor-ladder keypad pin every 1 ms
+#else
+	Keypad_Init();						// initially configure colum pins as input that generate interrupts and row as output
+#endif
+	Wakeup_Init();						// RTC alarm of the flow timeouts, running in STOP mode
+	Flow_Init();
+	Flow_Start(pinFlow, sizeof(pinFlow_t));			// Key sequences handled by the application
+	Flow_Start(layoutFlow, sizeof(layoutFlow_t));
+}
+
+/*
+ * Called by the main loop once lowPowerRequest is set and the UART is idle. Returns 1, and clears the request, if the
+ * device may go to STOP mode. Returns 0 while SysTick is needed by the storm protection, or TIM4 by a debounce (they
+ * stop in STOP mode): the main loop then only sleeps until the next tick or key. The flow timeouts run on the RTC and
+ * allow STOP mode.
+ */
+uint8_t App_StopAllowed(void) {
+	uint8_t	id;
+
+	if (!Storm_Rest()) {
+		return 0;
+	}
+	for (id = 0; id < NUM_KEYPADS; id++) {
+		if (keypads[id].debouncing) {
+			return 0;
+		}
+	}
+	lowPowerRequest = 0;
+	return 1;
+}
+
+/*
+ * MSG_BT_DOWN handler: for debug purpose, turn on the blue LED
+ */
+uint8_t Led_OnKeyDown(msgQueueDef *theMsg) {
+	GPIO_SetBits(LED_PORT, LED_BLUE_PIN);
+	return DISPATCH_CONTINUE;
+}
+
+/*
+ * MSG_BT_UP handler: turn the blue LED off
+ */
+uint8_t Led_OnKeyUp(msgQueueDef *theMsg) {
+	GPIO_ResetBits(LED_PORT, LED_BLUE_PIN);
+	return DISPATCH_CONTINUE;
+}
+
+/*
+ * MSG_BT_UP handler, registered last: ask the main loop to enter low power once the message is fully processed
+ */
+uint8_t Power_OnKeyUp(msgQueueDef *theMsg) {
+	lowPowerRequest = 1;
+	return DISPATCH_CONTINUE;
+}
+
+/*
+ * Flow testing if the keys entered are 1234 as a test password, and toggling the green LED if so. A wrong key, or no key
+ * for PIN_KEY_TIMEOUT_MS, restarts the password.
+ */
+static uint8_t pinFlow(flow_t *f) {
+	pinFlow_t	*pin = (pinFlow_t *) f;
+
+	FLOW_BEGIN(f);
+	while (1) {
+		FLOW_AWAIT_KEY(f);
+		pin->index = 0;
+		while (f->key == pinCode[pin->index]) {
+			if (++pin->index == sizeof(pinCode)) {
+				LED_PORT->ODR ^= LED_GREEN_PIN;	// Toggle Green LED
+				break;
+			}
+			FLOW_AWAIT_KEY_OR_TIMEOUT(f, PIN_KEY_TIMEOUT_MS);
+		}
+	}
+	FLOW_END(f);
+}
+
+/*
+ * Flow switching a keypad between the phone and the calculator layouts when * then # are pressed on it within
+ * LAYOUT_KEY_TIMEOUT_MS. It runs at the same time as pinFlow, both get every key.
+ */
+static uint8_t layoutFlow(flow_t *f) {
+	layoutFlow_t	*layout = (layoutFlow_t *) f;
+
+	FLOW_BEGIN(f);
+	while (1) {
+		FLOW_AWAIT_KEY(f);
+		if (f->key == '*') {
+			layout->deviceID = f->deviceID;
+			FLOW_AWAIT_KEY_OR_TIMEOUT(f, LAYOUT_KEY_TIMEOUT_MS);
+			if ((f->key == '#') && (f->deviceID == layout->deviceID)) {
+				Keymap_SetToggled(&keymaps[f->deviceID], keymaps[f->deviceID].toggled ^ (1 << LAYER_CALC));
+			}
+		}
+	}
+	FLOW_END(f);
+}
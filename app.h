@@ -0,0 +1,20 @@
+/*
+ * app.h
+ *
+ *  Author: Ahmed Talaat (aa_talaat@yahoo.com)
+ */
+
+#ifndef APP_H_
+#define APP_H_
+
+#include "queues.h"
+
+extern uint8_t	lowPowerRequest;		// set once a key is fully processed, the main loop may then sleep
+
+void App_Init(void);
+uint8_t App_StopAllowed(void);
+uint8_t Led_OnKeyDown(msgQueueDef *theMsg);
+uint8_t Led_OnKeyUp(msgQueueDef *theMsg);
+uint8_t Power_OnKeyUp(msgQueueDef *theMsg);
+
+#endif /* APP_H_ */
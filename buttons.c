@@ -8,25 +8,82 @@
 #include "stm32f10x.h"
 #include "buttons.h"
 #include "gpio.h"
+#include "keymap.h"
+#include "debounce.h"
+#include "dispatch.h"
+#include "storm.h"
 
-void ConfigKeypadInterrupt(void);
+static void ConfigKeypadInterrupt(keypad_t *keypad);
 
-// Holds the status of the pressed columns (1-4) of keys in the keypad
-BUTTON_STATE	keypadColState[4] = {BT_IDLE, BT_IDLE, BT_IDLE, BT_IDLE};
+/*
+ * Wiring of the keypads, see gpio.h
+ */
+static const keypadConfig_t keypadConfigs[NUM_KEYPADS] = {
+	{KEYPAD_PORT, KEYPAD_CLK, KEYPAD_PORTSOURCE,
+	 {KEYPAD_ROW1, KEYPAD_ROW2, KEYPAD_ROW3, KEYPAD_ROW4},
+	 {KEYPAD_COL1, KEYPAD_COL2, KEYPAD_COL3, KEYPAD_COL4}},
+#if NUM_KEYPADS > 1
+	{KEYPAD2_PORT, KEYPAD2_CLK, KEYPAD2_PORTSOURCE,
+	 {KEYPAD2_ROW1, KEYPAD2_ROW2, KEYPAD2_ROW3, KEYPAD2_ROW4},
+	 {KEYPAD2_COL1, KEYPAD2_COL2, KEYPAD2_COL3, KEYPAD2_COL4}},
+#endif
+};
+
+keypad_t	keypads[NUM_KEYPADS];
+uint8_t		keypadLineOwner[16];
+uint16_t	keypadExtiLines = 0;
 
-uint8_t	keyMap[16]={'1','2','3','A',
-					'4','5','6','B',
-					'7','8','9','C',
-					'*','0','#','D'};
+/*
+ * Build the run time state of every keypad and the EXTI line to keypad table used by the EXTI ISRs, then configure
+ * the keypads to wait for a key (column pins as input that generate interrupts and row as output).
+ */
+void Keypad_Init(void) {
+	keypad_t	*keypad;
+	uint8_t		id, i, line;
+
+	for (line = 0; line < 16; line++) {
+		keypadLineOwner[line] = KEYPAD_NO_LINE;
+	}
+	Storm_Init();
+
+	for (id = 0; id < NUM_KEYPADS; id++) {
+		keypad = &keypads[id];
+		keypad->config = &keypadConfigs[id];
+		keypad->id = id;
+		keypad->rowMask = 0;
+		keypad->colMask = 0;
+		keypad->colIndex = 0;
+		keypad->debouncing = 0;
+		keypad->snapshot = 0;
+		keypad->keyMap = keymaps[id].keyMap;
+		for (i = 0; i < 4; i++) {
+			keypad->rowMask |= keypad->config->rowPins[i];
+			keypad->colMask |= keypad->config->colPins[i];
+			keypad->colState[i] = BT_IDLE;
+			keypad->colKey[i] = KEYPAD_NO_KEY;
+			for (line = 0; line < 16; line++) {
+				if (keypad->config->colPins[i] == (1 << line)) {
+					keypadLineOwner[line] = (id << 2) | i;
+				}
+			}
+		}
+		keypadExtiLines |= keypad->colMask;
+		Debounce_Init(keypad);
+
+		ConfigKeypadInterrupt(keypad);	// once: EXTI_Init unmasks all the lines, even the ones quarantined by storm.c
+		Config_Keypad(keypad, ROW_OUT_COL_IN);
+	}
+}
 
 /*
  * This function will configure the GPIO, and associated external interrupt configuration as per the keypad scanning mode.
  * The mode parameter decides if the rows will be pullup inputs with falling edge interrupt and columns as outputs or vice versa
  */
 
-void Config_Keypad(KEYPAD_GPIO_MODE keypadMode) {
+void Config_Keypad(keypad_t *keypad, KEYPAD_GPIO_MODE keypadMode) {
 
-	GPIO_ConfigKeyPad(keypadMode);	// do the GPIO configuration as requested
+									// do the GPIO configuration as requested
+	GPIO_ConfigKeyPad(keypad->config->port, keypad->config->clk, keypad->rowMask, keypad->colMask, keypadMode);
 
 	switch (keypadMode) {
 		case ROW_IN_COL_OUT:
@@ -34,9 +91,8 @@ void Config_Keypad(KEYPAD_GPIO_MODE keypadMode) {
 			break;
 
 		case ROW_OUT_COL_IN:
-			ConfigKeypadInterrupt();// configure column pins Alternate function as external interrupt source
-									// and link each pin to its interrupt line
-			EnableKeypadExti_IRQ();	// Clear pending interrupts, and Enable interrupt mask for these pins
+									// The column pins are linked to their EXTI lines once, by Keypad_Init
+			EnableKeypadExti_IRQ(keypad);	// Clear pending interrupts, and Enable interrupt mask for these pins
 			break;
 		default:
 			break;
@@ -46,19 +102,21 @@ void Config_Keypad(KEYPAD_GPIO_MODE keypadMode) {
 /*
  * Configure the alternate function of the buttons as external interrupt source and link it to the external pins
  */
-void ConfigKeypadInterrupt(void) {
+static void ConfigKeypadInterrupt(keypad_t *keypad) {
 	EXTI_InitTypeDef   	EXTI_InitStructure;
+	uint8_t				line;
 
 	/* Enable AFIO clock */
 	RCC_APB2PeriphClockCmd(RCC_APB2Periph_AFIO, ENABLE);
 
-	/* Connect EXTI12-15 Line to PB.12-15 pin */
-	GPIO_EXTILineConfig(GPIO_PortSourceGPIOB, GPIO_PinSource12);
-	GPIO_EXTILineConfig(GPIO_PortSourceGPIOB, GPIO_PinSource13);
-	GPIO_EXTILineConfig(GPIO_PortSourceGPIOB, GPIO_PinSource14);
-	GPIO_EXTILineConfig(GPIO_PortSourceGPIOB, GPIO_PinSource15);
+	/* Connect the EXTI line of each column to its pin */
+	for (line = 0; line < 16; line++) {
+		if (keypad->colMask & (1 << line)) {
+			GPIO_EXTILineConfig(keypad->config->portSource, line);
+		}
+	}
 
-	EXTI_InitStructure.EXTI_Line = EXTI_Line12 | EXTI_Line13 | EXTI_Line14 | EXTI_Line15;
+	EXTI_InitStructure.EXTI_Line = keypad->colMask;
 	EXTI_InitStructure.EXTI_Mode = EXTI_Mode_Interrupt;
 	EXTI_InitStructure.EXTI_Trigger = EXTI_Trigger_Rising_Falling;
 	EXTI_InitStructure.EXTI_LineCmd = ENABLE;
@@ -66,56 +124,73 @@ void ConfigKeypadInterrupt(void) {
 }
 
 /*
- * Clear the interrupt mask for the 4 EXTI lines
+ * Clear the interrupt mask for the EXTI lines of the keypad, except the ones quarantined by storm.c.
+ * The mask register is shared by the keypads and updated from ISRs of different priorities, hence the critical section.
 */
-void EnableKeypadExti_IRQ(void){
-														// Clear the  EXTI line 12 pending bit
-	EXTI_ClearITPendingBit(EXTI_Line12 | EXTI_Line13 | EXTI_Line14 | EXTI_Line15);
-	EXTI->IMR = EXTI_IMR_MR12 | EXTI_IMR_MR13 | EXTI_IMR_MR14 | EXTI_IMR_MR15;
+void EnableKeypadExti_IRQ(keypad_t *keypad){
+	uint32_t	primask;
+														// Clear the EXTI lines pending bits
+	EXTI_ClearITPendingBit(keypad->colMask);
+	primask = __get_PRIMASK();
+	__disable_irq();
+	EXTI->IMR |= keypad->colMask & ~stormQuarantinedLines;
+	__set_PRIMASK(primask);
 }
 
 /*
- * Set the interrupt mask for the 4 EXTI lines
+ * Set the interrupt mask for the 4 EXTI lines of the keypad
 */
-void DisableKeypadExti_IRQ(void){
+void DisableKeypadExti_IRQ(keypad_t *keypad){
+	uint32_t	primask;
 														// Mask interrupt
-	EXTI->IMR &= ~(EXTI_IMR_MR12 | EXTI_IMR_MR13 | EXTI_IMR_MR14 | EXTI_IMR_MR15);
-														// Clear the EXTI line 12-15 pending bit
-	EXTI_ClearITPendingBit(EXTI_Line12 | EXTI_Line13 | EXTI_Line14 | EXTI_Line15);
+	primask = __get_PRIMASK();
+	__disable_irq();
+	EXTI->IMR &= ~keypad->colMask;
+	__set_PRIMASK(primask);
+														// Clear the EXTI lines pending bits
+	EXTI_ClearITPendingBit(keypad->colMask);
 }
 
 
 /*
  * This function is called after the user has pressed a key on the keypad. The key column activated due to user selection is
  * already known through the interrupt routines, and is passed to this function.
- * The function will switch the GPIO setup of the rows and columns to make the columns as output low, and will scan row by row
- * till it finds one which is low. Now that we know the row, and column index, using a lookup table, the function will
- * return an ascii code of the button pressed.
+ * The function will switch the GPIO setup of the rows to input pullup and of the column being decoded to output low, and will
+ * scan row by row till it finds one which is low. The other columns stay input pullup: a key held in another column, or
+ * noise on its wire, cannot pull a row low. Now that we know the row, and column index, using the keymap resolved from the active
+ * layers (keymap.c), the function will return an ascii code of the button pressed, or a layer key code. The matrix index
+ * of the key is kept in colKey for the contact statistics (health.c).
  * The function will return 0 if it cannot find and row with low logic. This can happen if the time between detecting the column
  * index and calling this function is too long so that the user has already removed his finger, and a button up message is
  * received in the main loop
  */
 
-uint8_t	getKeyPressed(uint8_t colIndex) {
-
-	uint8_t	rowIndex;
-
-	Config_Keypad(ROW_IN_COL_OUT);			// Configure keypad with column pins as output low and row pins as input pullup
-
-	if (!GPIO_ReadInputDataBit(KEYPAD_PORT, KEYPAD_ROW1)) {	// If a low level detected
-		rowIndex=0;
-	} else
-	if (!GPIO_ReadInputDataBit(KEYPAD_PORT, KEYPAD_ROW2)) {	// If a low level detected
-		rowIndex=1;
-	} else
-	if (!GPIO_ReadInputDataBit(KEYPAD_PORT, KEYPAD_ROW3)) {	// If a low level detected
-		rowIndex=2;
-	} else
-	if (!GPIO_ReadInputDataBit(KEYPAD_PORT, KEYPAD_ROW4)) {	// If a low level detected
-		rowIndex=3;
-	} else {
-		return 0;											// error detected
+uint8_t	getKeyPressed(keypad_t *keypad, uint8_t colIndex) {
+
+	uint16_t	rows;
+	uint8_t		rowIndex;
+
+											// Configure keypad with the column pin as output low and row pins as input pullup
+	GPIO_ConfigKeyPad(keypad->config->port, keypad->config->clk, keypad->rowMask, keypad->config->colPins[colIndex],
+					  ROW_IN_COL_OUT);
+
+	rows = GPIO_ReadInputData(keypad->config->port);		// all the rows in one read
+
+	for (rowIndex = 0; rowIndex < 4; rowIndex++) {
+		if (!(rows & keypad->config->rowPins[rowIndex])) {	// If a low level detected
+			keypad->colKey[colIndex] = 4*rowIndex+colIndex;
+			return (keypad->keyMap[4*rowIndex+colIndex]);
+		}
 	}
 
-	return (keyMap[4*rowIndex+colIndex]);
+	keypad->colKey[colIndex] = KEYPAD_NO_KEY;
+	return 0;												// error detected
+}
+
+/*
+ * MSG_BT_UP handler: the key is fully processed, reset its column status to idle
+ */
+uint8_t Keypad_OnKeyUp(msgQueueDef *theMsg) {
+	keypads[theMsg->deviceID].colState[theMsg->msgContent] = BT_IDLE;
+	return DISPATCH_CONTINUE;
 }
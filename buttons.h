@@ -8,14 +8,56 @@
 #define BUTTONS_H_
 
 #include "gpio.h"
+#include "queues.h"
+
+#define KEYPAD_NO_LINE		0xFF		// keypadLineOwner value for the EXTI lines not used by a keypad
+#define KEYPAD_NO_KEY		0xFF		// colKey value when no key was found in the column
 
 typedef enum {BT_IDLE, BT_DOWN, BT_UP} BUTTON_STATE;
 
-extern BUTTON_STATE	keypadColState[4];		// Holds the status of the pressed columns (1-4) of keys in the keypad
+/*
+ * Wiring of one keypad, kept in flash. Rows and columns must be on the same port, and no two keypads may use the same
+ * pin number for a column as they would share the EXTI line.
+ */
+typedef struct keypadConfig_s {
+	GPIO_TypeDef	*port;
+	uint32_t		clk;
+	uint8_t			portSource;				// GPIO_PortSourceGPIOx, to link the EXTI lines to the port
+	uint16_t		rowPins[4];
+	uint16_t		colPins[4];
+} keypadConfig_t;
+
+/*
+ * Run time state of one keypad
+ */
+typedef struct keypad_s {
+	const keypadConfig_t	*config;
+	uint8_t			id;						// index in keypads[], sent with the messages as deviceID
+	uint16_t		rowMask;
+	uint16_t		colMask;				// also the mask of its EXTI lines
+	uint8_t			colIndex;				// column being debounced
+	uint8_t			debouncing;				// 1 from the first edge until the debounce delay expires
+	uint8_t			bounceEdges;			// edges seen after the first one during the debounce delay (saturated)
+	uint16_t		bounceStart;			// TIM4 counter at the first edge
+	uint16_t		lastEdge;				// TIM4 counter at the last edge
+	uint8_t			delayMs;				// debounce delay of the transition being debounced
+	uint8_t			debounceMs[4];			// debounce delay of each column (debounce.c)
+	uint16_t		settle[4];				// settle time of each column, ms in 8.8 fixed point
+	uint16_t		snapshot;				// port input pins latched when the debounce delay expired
+	uint8_t			colKey[4];				// matrix index (4*row+col) of the key pressed in each column
+	const uint8_t	*keyMap;				// resolved keymap of the keypad (keymaps[id].keyMap)
+	BUTTON_STATE	colState[4];			// Holds the status of the pressed columns (1-4) of keys in the keypad
+} keypad_t;
+
+extern keypad_t		keypads[NUM_KEYPADS];
+extern uint8_t		keypadLineOwner[16];	// for each EXTI line: (keypad id << 2) | column index, or KEYPAD_NO_LINE
+extern uint16_t		keypadExtiLines;		// all the EXTI lines used by the keypads
 
-void Config_Keypad(KEYPAD_GPIO_MODE keypadMode);
-void EnableKeypadExti_IRQ(void);
-void DisableKeypadExti_IRQ(void);
-uint8_t	getKeyPressed(uint8_t colIndex);
+void Keypad_Init(void);
+void Config_Keypad(keypad_t *keypad, KEYPAD_GPIO_MODE keypadMode);
+void EnableKeypadExti_IRQ(keypad_t *keypad);
+void DisableKeypadExti_IRQ(keypad_t *keypad);
+uint8_t	getKeyPressed(keypad_t *keypad, uint8_t colIndex);
+uint8_t Keypad_OnKeyUp(msgQueueDef *theMsg);
 
 #endif /* BUTTONS_H_ */
@@ -0,0 +1,121 @@
+/*
+ * debounce.c
+ *
+ *  Author: Ahmed Talaat (aa_talaat@yahoo.com)
+ *
+ * Adaptive debounce delay (build with KEYPAD_ADAPTIVE_DEBOUNCE defined). New panels bounce for 2-3 ms while worn ones
+ * can bounce for 15 ms, so the fixed 20 ms delay is far too long for most keys.
+ *
+ * Each column of a keypad keeps a settle time, in 8.8 fixed point ms, fed with the bounce duration measured by the EXTI
+ * ISR for every press and release (time from the first to the last edge):
+ *	- A longer bounce is taken at once, a shorter one is followed slowly (1/8 of the difference per transition).
+ *	- The debounce delay of the column is 1.5 times the settle time plus DEBOUNCE_MARGIN_MS, between DEBOUNCE_MIN_MS and
+ *	  DEBOUNCE_MS.
+ *	- If the contact is still bouncing in the last DEBOUNCE_QUIET_MS of a shortened delay (a worn key in a column of new ones), the TIM4
+ *	  top half does not decode it: the delay is extended up to DEBOUNCE_MS (Debounce_Extend), so a key is never decoded
+ *	  earlier than the fixed delay would while it bounces. The longer bounce then raises the settle time of the column.
+ *	- If the contact was still bouncing near the end of DEBOUNCE_MS, or bounced more than DEBOUNCE_CHATTER_EDGES times,
+ *	  the key chatters: the column falls back to DEBOUNCE_MS and converges again from there.
+ *
+ * Only the presses use the shortened delay: while a key is held, a worn contact can lose contact for a few ms, and
+ * debouncing that with the short delay would report it as a new press more often than the fixed delay does. The release
+ * latency does not matter to the user, and the release bounce still feeds the settle time.
+ *
+ * The columns start at DEBOUNCE_MS, so a panel is never debounced shorter than what it has shown. Without
+ * KEYPAD_ADAPTIVE_DEBOUNCE, every column keeps DEBOUNCE_MS.
+ *
+ * In both modes, a column holding a key is only read as released once its contact has been quiet for more than
+ * DEBOUNCE_QUIET_MS ticks of TIM4, so at least DEBOUNCE_QUIET_MS (Debounce_ExtendHeld): a chattering key loses contact
+ * every few ms, and a delay ending in one of these losses would report a release then a new press.
+ */
+
+#include "stm32f10x.h"
+#include "debounce.h"
+
+static void setDelay(keypad_t *keypad, uint8_t colIndex);
+
+/*
+ * Every column of the keypad starts with the fixed debounce delay
+ */
+void Debounce_Init(keypad_t *keypad) {
+	uint8_t	i;
+
+	for (i = 0; i < 4; i++) {
+		keypad->settle[i] = DEBOUNCE_MS << 8;
+		keypad->debounceMs[i] = DEBOUNCE_MS;
+	}
+}
+
+/*
+ * Called from the TIM4 top half when the debounce delay of the keypad expires. If the delay was shortened and the
+ * contact bounced during its last DEBOUNCE_QUIET_MS, re-arm the channel for the rest of DEBOUNCE_MS and return 1: the lines stay
+ * enabled and the bounce keeps being measured. Returns 0 to decode the keypad.
+ */
+uint8_t Debounce_Extend(keypad_t *keypad) {
+	uint8_t	bounceMs = Debounce_BounceMs(keypad);
+
+	if ((keypad->delayMs >= DEBOUNCE_MS) || (bounceMs + DEBOUNCE_QUIET_MS < keypad->delayMs)) {
+		return 0;
+	}
+	enableDebounceTimer(keypad->id, DEBOUNCE_MS - keypad->delayMs);
+	keypad->delayMs = DEBOUNCE_MS;
+	return 1;
+}
+
+/*
+ * Called from the TIM4 top half when the debounce delay of the keypad expires, after Debounce_Extend. If the column
+ * holds a key and the contact bounced less than DEBOUNCE_QUIET_MS ago (the TIM4 ticks are whole ms), the key is losing
+ * contact again rather than released: re-arm the channel for DEBOUNCE_MS and return 1. Returns 0 to decode the keypad.
+ * A column down with no key found (noise on its wire) is not held: re-arming it would keep the keypad debouncing the
+ * noise, and the other columns would wait meanwhile.
+ */
+uint8_t Debounce_ExtendHeld(keypad_t *keypad) {
+	if ((keypad->colState[keypad->colIndex] != BT_DOWN) || (keypad->colKey[keypad->colIndex] == KEYPAD_NO_KEY) ||
+		((uint16_t) (TIM_GetCounter(TIM4) - keypad->lastEdge) > DEBOUNCE_QUIET_MS)) {
+		return 0;
+	}
+	enableDebounceTimer(keypad->id, DEBOUNCE_MS);
+	return 1;
+}
+
+/*
+ * Time from the first to the last edge of the debounce delay, in ms. Debounce_ExtendHeld re-arms the delay without
+ * restarting it, so a chattering key can bounce for longer than a uint8_t: it saturates at 0xFF, which still reads as
+ * chatter for the settle time and health.c.
+ */
+uint8_t Debounce_BounceMs(keypad_t *keypad) {
+	uint16_t	bounceMs = keypad->lastEdge - keypad->bounceStart;
+
+	return (bounceMs > 0xFF) ? 0xFF : (uint8_t) bounceMs;
+}
+
+/*
+ * Called from the keypad bottom half once the debounce delay of a column has expired, with the bounce seen during
+ * that delay (keypad->delayMs)
+ */
+void Debounce_Adapt(keypad_t *keypad, uint8_t colIndex, uint8_t bounceEdges, uint8_t bounceMs) {
+	uint16_t	bounce = (uint16_t) bounceMs << 8;
+
+	if ((bounceMs + DEBOUNCE_QUIET_MS >= keypad->delayMs) || (bounceEdges > DEBOUNCE_CHATTER_EDGES)) {
+		keypad->settle[colIndex] = DEBOUNCE_MS << 8;	// still bouncing at the end, or chatter: fall back
+	} else if (bounce > keypad->settle[colIndex]) {
+		keypad->settle[colIndex] = bounce;
+	} else {
+		keypad->settle[colIndex] -= (keypad->settle[colIndex] - bounce) >> DEBOUNCE_DECAY_SHIFT;
+	}
+	setDelay(keypad, colIndex);
+}
+
+/*
+ * delay = settle * 1.5 + margin, rounded up and clamped
+ */
+static void setDelay(keypad_t *keypad, uint8_t colIndex) {
+	uint16_t	delay = ((keypad->settle[colIndex] + (keypad->settle[colIndex] >> 1) + 0xFF) >> 8) + DEBOUNCE_MARGIN_MS;
+
+	if (delay < DEBOUNCE_MIN_MS) {
+		delay = DEBOUNCE_MIN_MS;
+	} else if (delay > DEBOUNCE_MS) {
+		delay = DEBOUNCE_MS;
+	}
+	keypad->debounceMs[colIndex] = (uint8_t) delay;
+}
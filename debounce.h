@@ -0,0 +1,35 @@
+/*
+ * debounce.h
+ *
+ *  Author: Ahmed Talaat (aa_talaat@yahoo.com)
+ */
+
+#ifndef DEBOUNCE_H_
+#define DEBOUNCE_H_
+
+#include "buttons.h"
+#include "TIM4.h"
+
+#define DEBOUNCE_MIN_MS			3			// shortest debounce delay of the adaptive mode
+#define DEBOUNCE_MARGIN_MS		2			// added to 1.5 times the settle time (covers the 1 ms TIM4 resolution)
+#define DEBOUNCE_DECAY_SHIFT	3			// the settle time follows a shorter bounce by 1/8 of the difference
+#define DEBOUNCE_QUIET_MS		2			// a contact quiet for less than this at the end of the delay still bounces
+#define DEBOUNCE_CHATTER_EDGES	6			// more bounce edges than this in one transition: back to DEBOUNCE_MS
+
+/*
+ * Debounce delay of a column: measured from the contact bounce with KEYPAD_ADAPTIVE_DEBOUNCE, DEBOUNCE_MS otherwise.
+ * Only the presses are shortened, the edges of a column holding a key (its release, or a contact loss) keep DEBOUNCE_MS.
+ */
+#ifdef KEYPAD_ADAPTIVE_DEBOUNCE
+#define DEBOUNCE_DELAY(keypad, col)		(((keypad)->colState[col] == BT_DOWN) ? DEBOUNCE_MS : (keypad)->debounceMs[col])
+#else
+#define DEBOUNCE_DELAY(keypad, col)		DEBOUNCE_MS
+#endif
+
+void Debounce_Init(keypad_t *keypad);
+uint8_t Debounce_Extend(keypad_t *keypad);
+uint8_t Debounce_ExtendHeld(keypad_t *keypad);
+uint8_t Debounce_BounceMs(keypad_t *keypad);
+void Debounce_Adapt(keypad_t *keypad, uint8_t colIndex, uint8_t bounceEdges, uint8_t bounceMs);
+
+#endif /* DEBOUNCE_H_ */
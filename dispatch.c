@@ -0,0 +1,58 @@
+/*
+ * dispatch.c
+ *
+ *  Author: Ahmed Talaat (aa_talaat@yahoo.com)
+ *
+ * Delivers the messages of IsrToMainQueue to the handlers registered in dispatch_table.h.
+ *
+ * The table is built by the compiler: one null terminated array of handlers per MSGID, and an array of these lists
+ * indexed by MSGID. Both are const, so they stay in flash, and dispatching a message is one indexed load followed by
+ * the calls of its handlers. No heap and no registration at run time.
+ */
+#include "stm32f10x.h"
+#include "dispatch.h"
+#include "dispatch_table.h"
+
+#ifdef KEYPAD_PROFILE
+profileStat_t	dispatchProfile[MSG_COUNT];
+#endif
+
+/* Prototypes of all the registered handlers */
+#define DISPATCH_DECLARE(handler)		uint8_t handler(msgQueueDef *theMsg);
+#define DISPATCH_DECLARE_LIST(msgID)	msgID##_SUBSCRIBERS(DISPATCH_DECLARE)
+DISPATCH_MESSAGES(DISPATCH_DECLARE_LIST)
+
+/* One handler list per message */
+#define DISPATCH_ENTRY(handler)			handler,
+#define DISPATCH_LIST(msgID)			static const msgHandler_t msgID##_handlers[] = { msgID##_SUBSCRIBERS(DISPATCH_ENTRY) 0 };
+DISPATCH_MESSAGES(DISPATCH_LIST)
+
+/* Fails to compile if a MSGID has no list */
+#define DISPATCH_COUNT(msgID)			+1
+typedef char dispatchTableComplete[((0 DISPATCH_MESSAGES(DISPATCH_COUNT)) == MSG_COUNT) ? 1 : -1];
+
+/* The lists indexed by MSGID */
+#define DISPATCH_TABLE_ENTRY(msgID)		[msgID] = msgID##_handlers,
+static const msgHandler_t * const dispatchTable[MSG_COUNT] = {
+	DISPATCH_MESSAGES(DISPATCH_TABLE_ENTRY)
+};
+
+/*
+ * Call the handlers of the message in their registration order, until one of them consumes it
+ */
+void dispatchMessage(msgQueueDef *theMsg) {
+	const msgHandler_t	*handler;
+	uint32_t			start;
+
+	if (theMsg->msgID >= MSG_COUNT) {
+		return;
+	}
+
+	PROFILE_START(start);
+	for (handler = dispatchTable[theMsg->msgID]; *handler; handler++) {
+		if ((*handler)(theMsg) == DISPATCH_STOP) {
+			break;
+		}
+	}
+	PROFILE_STOP(start, &dispatchProfile[theMsg->msgID]);
+}
@@ -0,0 +1,24 @@
+/*
+ * dispatch.h
+ *
+ *  Author: Ahmed Talaat (aa_talaat@yahoo.com)
+ */
+
+#ifndef DISPATCH_H_
+#define DISPATCH_H_
+
+#include "queues.h"
+#include "profile.h"
+
+#define DISPATCH_CONTINUE	0
+#define DISPATCH_STOP		1
+
+typedef uint8_t (*msgHandler_t)(msgQueueDef *theMsg);
+
+#ifdef KEYPAD_PROFILE
+extern profileStat_t	dispatchProfile[MSG_COUNT];	// cycles per dispatched message
+#endif
+
+void dispatchMessage(msgQueueDef *theMsg);
+
+#endif /* DISPATCH_H_ */
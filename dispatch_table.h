@@ -0,0 +1,44 @@
+/*
+ * dispatch_table.h
+ *
+ *  Author: Ahmed Talaat (aa_talaat@yahoo.com)
+ *
+ * Registration of the message handlers. For each MSGID, <MSGID>_SUBSCRIBERS lists the handlers called, in this order,
+ * for every message of that type taken out of IsrToMainQueue. A handler is a function
+ *
+ *		uint8_t handler(msgQueueDef *theMsg);
+ *
+ * returning DISPATCH_CONTINUE, or DISPATCH_STOP to consume the message (the handlers after it are not called).
+ * To add a feature, write its handler in its own module and add it to the lists below: the main loop is not touched.
+ * Every MSGID of queues.h must have a list, which may be empty.
+ */
+
+#ifndef DISPATCH_TABLE_H_
+#define DISPATCH_TABLE_H_
+
+#define DISPATCH_MESSAGES(M)	\
+	M(MSG_BT_DOWN)				\
+	M(MSG_BT_UP)				\
+	M(MSG_KEY_CHATTER)			\
+	M(MSG_LINE_FAULT)
+
+#define MSG_BT_DOWN_SUBSCRIBERS(H)	\
+	H(Led_OnKeyDown)				\
+	H(Keymap_OnKeyDown)				\
+	H(UART_OnEvent)					\
+	H(Flow_OnKeyDown)
+
+#define MSG_BT_UP_SUBSCRIBERS(H)	\
+	H(Led_OnKeyUp)					\
+	H(Keypad_OnKeyUp)				\
+	H(Keymap_OnKeyUp)				\
+	H(UART_OnEvent)					\
+	H(Power_OnKeyUp)
+
+#define MSG_KEY_CHATTER_SUBSCRIBERS(H)	\
+	H(UART_OnEvent)
+
+#define MSG_LINE_FAULT_SUBSCRIBERS(H)	\
+	H(UART_OnEvent)
+
+#endif /* DISPATCH_TABLE_H_ */
@@ -0,0 +1,158 @@
+/*
+ * flow.c
+ *
+ *  Author: Ahmed Talaat (aa_talaat@yahoo.com)
+ *
+ * Flow engine (see flow.h). The frames come from a static pool of FLOW_POOL_SIZE frames of 16 bytes (Cortex-M3), there is no
+ * heap and no stack per flow. Everything runs in the main loop:
+ *	- Flow_OnKeyDown() is subscribed to MSG_BT_DOWN in dispatch_table.h, after Keymap_OnKeyDown so that the layer keys
+ *	  never reach the flows. It resumes every flow waiting for a key.
+ *	- Flow_Poll() is called at every main loop iteration and resumes the flows whose timeout has expired.
+ *
+ * The time base is the RTC (wakeup.c), which keeps counting in STOP mode: while flows wait with a timeout, its alarm is
+ * set to the earliest deadline, and the main loop still enters STOP mode between the keys. The alarm raises wakeupDue,
+ * so Flow_Poll() only reads the RTC when a timeout may have expired, and then tells the main loop to go back to STOP.
+ */
+
+#include "stm32f10x.h"
+#include "flow.h"
+#include "dispatch.h"
+#include "wakeup.h"
+
+typedef union {
+	flow_t		header;
+	uint8_t		bytes[(sizeof(flow_t) + FLOW_FRAME_VARS + sizeof(void *) - 1) & ~(sizeof(void *) - 1)];	// 16 bytes on the Cortex-M3
+	void		*align;
+} flowFrame_t;
+
+static flowFrame_t	flowPool[FLOW_POOL_SIZE];
+
+#ifdef KEYPAD_PROFILE
+profileStat_t		flowResumeProfile;
+#endif
+
+static void resumeFlow(flow_t *f);
+static void updateFlowTimer(void);
+
+/*
+ * Give all the frames back to the pool, before the application starts its flows
+ */
+void Flow_Init(void) {
+	uint8_t	i;
+
+	for (i = 0; i < FLOW_POOL_SIZE; i++) {
+		flowPool[i].header.run = 0;
+	}
+	Wakeup_Cancel();
+}
+
+/*
+ * Take a frame from the pool and run the flow up to its first wait. frameSize is the size of the flow frame structure,
+ * which starts with its flow_t header. Returns 0 if the pool is full or the frame does not fit.
+ */
+flow_t *Flow_Start(flowFn_t run, uint8_t frameSize) {
+	flow_t	*f;
+	uint8_t	i, j;
+
+	if (frameSize > sizeof(flowPool[0].bytes)) {
+		return 0;
+	}
+	for (i = 0; i < FLOW_POOL_SIZE; i++) {
+		f = &flowPool[i].header;
+		if (f->run == 0) {
+			for (j = 0; j < sizeof(flowPool[i].bytes); j++) {
+				flowPool[i].bytes[j] = 0;
+			}
+			f->run = run;
+			resumeFlow(f);
+			updateFlowTimer();
+			return f;
+		}
+	}
+	return 0;
+}
+
+/*
+ * Resume the flows whose timeout has expired, with FLOW_TIMEOUT as key, once the alarm went off. Returns 1 if it did,
+ * the alarm may have woken the device up from STOP mode.
+ */
+uint8_t Flow_Poll(void) {
+	flow_t		*f;
+	uint16_t	now;
+	uint8_t		i;
+
+	if (!wakeupDue) {
+		return 0;
+	}
+	wakeupDue = 0;
+	now = Wakeup_Now();
+	for (i = 0; i < FLOW_POOL_SIZE; i++) {
+		f = &flowPool[i].header;
+		if ((f->run != 0) && (f->wait & FLOW_WAIT_TIME) && ((int16_t) (now - f->deadline) >= 0)) {
+			f->key = FLOW_TIMEOUT;
+			resumeFlow(f);
+		}
+	}
+	updateFlowTimer();
+	return 1;
+}
+
+/*
+ * MSG_BT_DOWN handler: resume the flows waiting for a key. A column edge with no row found (content 0, e.g. noise on a
+ * keypad wire) is not a key.
+ */
+uint8_t Flow_OnKeyDown(msgQueueDef *theMsg) {
+	flow_t	*f;
+	uint8_t	i;
+	uint32_t t;
+
+	if (theMsg->msgContent == 0) {
+		return DISPATCH_CONTINUE;
+	}
+	PROFILE_START(t);
+	for (i = 0; i < FLOW_POOL_SIZE; i++) {
+		f = &flowPool[i].header;
+		if ((f->run != 0) && (f->wait & FLOW_WAIT_KEY)) {
+			f->key = theMsg->msgContent;
+			f->deviceID = theMsg->deviceID;
+			resumeFlow(f);
+		}
+	}
+	updateFlowTimer();
+	PROFILE_STOP(t, &flowResumeProfile);
+	return DISPATCH_CONTINUE;
+}
+
+/*
+ * Run a flow up to its next wait, and give its frame back to the pool when it ends
+ */
+static void resumeFlow(flow_t *f) {
+	f->wait = 0;
+	if (f->run(f) == FLOW_DONE) {
+		f->run = 0;
+	}
+}
+
+/*
+ * Set the alarm to the earliest deadline of the flows waiting with a timeout, or cancel it if none does
+ */
+static void updateFlowTimer(void) {
+	flow_t		*f;
+	uint16_t	earliest = 0;
+	uint8_t		i, waiting = 0;
+
+	for (i = 0; i < FLOW_POOL_SIZE; i++) {
+		f = &flowPool[i].header;
+		if ((f->run != 0) && (f->wait & FLOW_WAIT_TIME)) {
+			if (!waiting || ((int16_t) (f->deadline - earliest) < 0)) {
+				earliest = f->deadline;
+			}
+			waiting = 1;
+		}
+	}
+	if (waiting) {
+		Wakeup_Set(earliest);
+	} else {
+		Wakeup_Cancel();
+	}
+}
@@ -0,0 +1,73 @@
+/*
+ * flow.h
+ *
+ *  Author: Ahmed Talaat (aa_talaat@yahoo.com)
+ *
+ * Stackless coroutines ("flows") to write key sequences as straight code instead of state machines:
+ *
+ *	static uint8_t myFlow(flow_t *f) {
+ *		myFrame_t *frame = (myFrame_t *) f;		// variables kept across the waits live in the frame
+ *
+ *		FLOW_BEGIN(f);
+ *		FLOW_AWAIT_KEY(f);						// suspends until the next key, then f->key is its code
+ *		FLOW_AWAIT_KEY_OR_TIMEOUT(f, 1000);		// same, f->key is FLOW_TIMEOUT if no key within 1000 ms
+ *		FLOW_END(f);							// the frame returns to the pool
+ *	}
+ *
+ *	Flow_Start(myFlow, sizeof(myFrame_t));
+ *
+ * A flow function is re-entered from its start at every resume, and jumps to the line it was suspended at. As with any
+ * stackless coroutine, its local variables are lost across the waits (keep them in the frame) and the waits cannot be
+ * inside a switch statement or inside a function called by the flow.
+ */
+
+#ifndef FLOW_H_
+#define FLOW_H_
+
+#include "queues.h"
+#include "profile.h"
+#include "wakeup.h"
+
+#define FLOW_POOL_SIZE		4			// flows running at the same time
+#define FLOW_FRAME_VARS		4			// bytes of a frame left for the variables of a flow, after its flow_t header
+
+#define FLOW_RUNNING		0
+#define FLOW_DONE			1
+
+#define FLOW_WAIT_KEY		0x01
+#define FLOW_WAIT_TIME		0x02
+
+#define FLOW_TIMEOUT		0xFF		// f->key after a timeout (no layer resolves a key to 0xFF, KM_TRANS)
+
+typedef struct flow_s {
+	uint8_t		(*run)(struct flow_s *f);	// flow function, 0 for a free frame
+	uint16_t	resume;						// line to resume at, 0 to start
+	uint8_t		wait;						// FLOW_WAIT_xxx
+	uint8_t		key;						// key that resumed the flow, or FLOW_TIMEOUT
+	uint8_t		deviceID;					// keypad of that key
+	uint16_t	deadline;					// Wakeup_Now() value of the timeout
+} flow_t;
+
+typedef uint8_t (*flowFn_t)(flow_t *f);
+
+#define FLOW_BEGIN(f)			switch ((f)->resume) { case 0:
+
+#define FLOW_AWAIT_KEY(f)		do { (f)->wait = FLOW_WAIT_KEY; (f)->resume = __LINE__; return FLOW_RUNNING; \
+									 case __LINE__:; } while (0)
+
+#define FLOW_AWAIT_KEY_OR_TIMEOUT(f, ms)	\
+								do { (f)->wait = FLOW_WAIT_KEY | FLOW_WAIT_TIME; (f)->deadline = Wakeup_Now() + (ms); \
+									 (f)->resume = __LINE__; return FLOW_RUNNING; case __LINE__:; } while (0)
+
+#define FLOW_END(f)				} return FLOW_DONE
+
+#ifdef KEYPAD_PROFILE
+extern profileStat_t		flowResumeProfile;	// cycles to deliver a key to the flows
+#endif
+
+void Flow_Init(void);
+flow_t *Flow_Start(flowFn_t run, uint8_t frameSize);
+uint8_t Flow_Poll(void);
+uint8_t Flow_OnKeyDown(msgQueueDef *theMsg);
+
+#endif /* FLOW_H_ */
@@ -0,0 +1,140 @@
+/*
+ * frame.c
+ *
+ *  Author: Ahmed Talaat (aa_talaat@yahoo.com)
+ *
+ * Contains the functions required to build and parse the event frames exchanged with the host (see frame.h for the
+ * layout). The sender side fills a frame with putEventInFrame() and then closes it with sealFrame() which writes the
+ * header and the CRC. The receiver side feeds every received byte into decodeFrameByte() which resynchronises on
+ * FRAME_SYNC by itself after a corrupted frame.
+ *
+ * The CRC uses a 16 entries (nibble) table: it costs two lookups per byte and only 32 bytes of flash.
+ */
+#include "frame.h"
+
+static const uint16_t crcNibbleTable[16] = {
+	0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50A5, 0x60C6, 0x70E7,
+	0x8108, 0x9129, 0xA14A, 0xB16B, 0xC18C, 0xD1AD, 0xE1CE, 0xF1EF
+};
+
+/*
+ * CRC-16/CCITT of a block of bytes. Pass 0xFFFF as crc for a new computation, or a previous result to continue it.
+ */
+uint16_t frameCrc16(uint16_t crc, const uint8_t *data, uint8_t length) {
+
+	while (length--) {
+		crc = (crc << 4) ^ crcNibbleTable[(crc >> 12) ^ (*data >> 4)];
+		crc = (crc << 4) ^ crcNibbleTable[(crc >> 12) ^ (*data & 0x0F)];
+		data++;
+	}
+	return crc;
+}
+
+/*
+ * Empty the frame so that it can be filled again
+ */
+void initializeFrame(frameBuffer_t *theFrame) {
+	theFrame->nEvents = 0;
+}
+
+/*
+ * Append one event to the frame. Returns 0xFF if the frame is full, 1 otherwise.
+ */
+uint8_t putEventInFrame(frameBuffer_t *theFrame, uint8_t msgID, uint8_t deviceID, uint8_t msgContent) {
+	uint8_t	*event;
+
+	if (theFrame->nEvents >= FRAME_MAX_EVENTS) {
+		return(0xFF);
+	}
+	event = &theFrame->data[FRAME_HEADER_SIZE + FRAME_EVENT_SIZE*theFrame->nEvents];
+	event[0] = (deviceID << 4) | (msgID & 0x0F);
+	event[1] = msgContent;
+	theFrame->nEvents++;
+	return(1);
+}
+
+/*
+ * Write the header and the CRC of the frame. Returns the number of bytes to transmit starting at theFrame->data.
+ */
+uint8_t sealFrame(frameBuffer_t *theFrame, uint8_t seq) {
+	uint8_t		payloadLength = FRAME_EVENT_SIZE*theFrame->nEvents;
+	uint16_t	crc;
+
+	theFrame->data[0] = FRAME_SYNC;
+	theFrame->data[1] = payloadLength;
+	theFrame->data[2] = seq;
+
+	crc = frameCrc16(0xFFFF, &theFrame->data[1], payloadLength + 2);
+	theFrame->data[FRAME_HEADER_SIZE + payloadLength] = (uint8_t) crc;
+	theFrame->data[FRAME_HEADER_SIZE + payloadLength + 1] = (uint8_t) (crc >> 8);
+
+	return (FRAME_HEADER_SIZE + payloadLength + FRAME_CRC_SIZE);
+}
+
+/*
+ * Reset the decoder to wait for the next FRAME_SYNC
+ */
+void initializeFrameDecoder(frameDecoder_t *theDecoder) {
+	theDecoder->state = FRAME_WAIT_SYNC;
+	theDecoder->index = 0;
+	theDecoder->length = 0;
+}
+
+/*
+ * Feed one received byte into the decoder.
+ * Returns 1 when a complete frame with a valid CRC is available in theDecoder->data (use the FRAME_xxx macros to read it),
+ * 0xFF if a frame was dropped because of a bad length or CRC, and 0 if more bytes are needed.
+ */
+uint8_t decodeFrameByte(frameDecoder_t *theDecoder, uint8_t byte) {
+	uint16_t	crc;
+
+	switch (theDecoder->state) {
+		case FRAME_WAIT_SYNC:
+			if (byte == FRAME_SYNC) {
+				theDecoder->data[0] = byte;
+				theDecoder->index = 1;
+				theDecoder->state = FRAME_WAIT_LEN;
+			}
+			break;
+
+		case FRAME_WAIT_LEN:
+			if ((byte > FRAME_EVENT_SIZE*FRAME_MAX_EVENTS) || (byte % FRAME_EVENT_SIZE)) {
+				initializeFrameDecoder(theDecoder);			// cannot be a length, look for the next sync
+				return(0xFF);
+			}
+			theDecoder->data[theDecoder->index++] = byte;
+			theDecoder->length = FRAME_HEADER_SIZE + byte + FRAME_CRC_SIZE;
+			theDecoder->state = FRAME_WAIT_SEQ;
+			break;
+
+		case FRAME_WAIT_SEQ:
+			theDecoder->data[theDecoder->index++] = byte;
+			theDecoder->state = (theDecoder->data[1]) ? FRAME_WAIT_PAYLOAD : FRAME_WAIT_CRC;
+			break;
+
+		case FRAME_WAIT_PAYLOAD:
+			theDecoder->data[theDecoder->index++] = byte;
+			if (theDecoder->index == theDecoder->length - FRAME_CRC_SIZE) {
+				theDecoder->state = FRAME_WAIT_CRC;
+			}
+			break;
+
+		case FRAME_WAIT_CRC:
+			theDecoder->data[theDecoder->index++] = byte;
+			if (theDecoder->index == theDecoder->length) {
+				theDecoder->state = FRAME_WAIT_SYNC;
+				crc = frameCrc16(0xFFFF, &theDecoder->data[1], theDecoder->length - FRAME_CRC_SIZE - 1);
+				if ((theDecoder->data[theDecoder->length - 2] == (uint8_t) crc) &&
+					(theDecoder->data[theDecoder->length - 1] == (uint8_t) (crc >> 8))) {
+					return(1);
+				}
+				return(0xFF);
+			}
+			break;
+
+		default:
+			initializeFrameDecoder(theDecoder);
+			break;
+	}
+	return(0);
+}
@@ -0,0 +1,61 @@
+/*
+ * frame.h
+ *
+ *  Author: Ahmed Talaat (aa_talaat@yahoo.com)
+ *
+ * Framing of keypad events sent to the host over the UART. This module does not touch any peripheral so it is
+ * shared as-is between the firmware and the host tools.
+ *
+ * Frame layout (all fields are bytes):
+ *
+ *		SYNC | LEN | SEQ | EVENT_0 ... EVENT_n-1 | CRC_L | CRC_H
+ *
+ *	- SYNC is always FRAME_SYNC.
+ *	- LEN is the number of payload bytes (2 per event), at most 2*FRAME_MAX_EVENTS.
+ *	- SEQ is incremented by one per frame, so the host can detect lost frames.
+ *	- Each event is 2 bytes: the msgID (low nibble) with the deviceID (high nibble), and the msgContent.
+ *	- The CRC is a CRC-16/CCITT (poly 0x1021, init 0xFFFF) computed over LEN, SEQ and the payload.
+ */
+
+#ifndef FRAME_H_
+#define FRAME_H_
+
+#include <stdint.h>
+
+#define FRAME_SYNC			0xA5
+#define FRAME_MAX_EVENTS	16
+#define FRAME_EVENT_SIZE	2
+#define FRAME_HEADER_SIZE	3
+#define FRAME_CRC_SIZE		2
+#define FRAME_MAX_SIZE		(FRAME_HEADER_SIZE + FRAME_EVENT_SIZE*FRAME_MAX_EVENTS + FRAME_CRC_SIZE)
+
+typedef struct frameBuffer_s {			// a frame being filled with events
+	uint8_t		nEvents;
+	uint8_t		data[FRAME_MAX_SIZE];
+} frameBuffer_t;
+
+typedef enum {FRAME_WAIT_SYNC, FRAME_WAIT_LEN, FRAME_WAIT_SEQ, FRAME_WAIT_PAYLOAD, FRAME_WAIT_CRC} FRAME_DECODER_STATE;
+
+typedef struct frameDecoder_s {			// byte by byte frame parser used by the receiver
+	FRAME_DECODER_STATE	state;
+	uint8_t		index;
+	uint8_t		length;
+	uint8_t		data[FRAME_MAX_SIZE];
+} frameDecoder_t;
+
+uint16_t frameCrc16(uint16_t crc, const uint8_t *data, uint8_t length);
+
+void initializeFrame(frameBuffer_t *theFrame);
+uint8_t putEventInFrame(frameBuffer_t *theFrame, uint8_t msgID, uint8_t deviceID, uint8_t msgContent);
+uint8_t sealFrame(frameBuffer_t *theFrame, uint8_t seq);
+
+void initializeFrameDecoder(frameDecoder_t *theDecoder);
+uint8_t decodeFrameByte(frameDecoder_t *theDecoder, uint8_t byte);
+
+#define FRAME_SEQ(d)			((d)->data[2])
+#define FRAME_NEVENTS(d)		((d)->data[1] / FRAME_EVENT_SIZE)
+#define FRAME_EVENT_ID(d, i)	((d)->data[FRAME_HEADER_SIZE + FRAME_EVENT_SIZE*(i)] & 0x0F)
+#define FRAME_EVENT_DEV(d, i)	((d)->data[FRAME_HEADER_SIZE + FRAME_EVENT_SIZE*(i)] >> 4)
+#define FRAME_EVENT_VAL(d, i)	((d)->data[FRAME_HEADER_SIZE + FRAME_EVENT_SIZE*(i) + 1])
+
+#endif /* FRAME_H_ */
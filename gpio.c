@@ -51,41 +51,67 @@ void GPIO_ConfigDiscoveryLEDs(void) {
 }
 
 /*
- * Configure the GPIO pins connected to the keypad. The mode parameter decides if the rows will be pullup inputs and columns as
+ * Configure the USART1 TX pin (PA09) as alternate function push-pull
+*/
+void GPIO_ConfigUART(void) {
+	GPIO_InitTypeDef 	GPIO_InitStruct;
+
+	RCC_APB2PeriphClockCmd(UART_CLK, ENABLE);
+	GPIO_InitStruct.GPIO_Speed = GPIO_Speed_2MHz;
+	GPIO_InitStruct.GPIO_Pin = UART_TX_PIN;
+	GPIO_InitStruct.GPIO_Mode = GPIO_Mode_AF_PP;
+	GPIO_Init(UART_PORT, &GPIO_InitStruct);
+}
+
+/*
+ * Configure the resistor-ladder keypad pin (PA01) as analog input for the ADC
+*/
+void GPIO_ConfigLadder(void) {
+	GPIO_InitTypeDef 	GPIO_InitStruct;
+
+	RCC_APB2PeriphClockCmd(LADDER_CLK, ENABLE);
+	GPIO_InitStruct.GPIO_Speed = GPIO_Speed_2MHz;
+	GPIO_InitStruct.GPIO_Pin = LADDER_PIN;
+	GPIO_InitStruct.GPIO_Mode = GPIO_Mode_AIN;
+	GPIO_Init(LADDER_PORT, &GPIO_InitStruct);
+}
+
+/*
+ * Configure the GPIO pins connected to a keypad. The mode parameter decides if the rows will be pullup inputs and columns as
  * outputs or vice versa.
  * The output pins are reset all to low.
  */
 
-void GPIO_ConfigKeyPad(KEYPAD_GPIO_MODE keypadMode) {
+void GPIO_ConfigKeyPad(GPIO_TypeDef *port, uint32_t clk, uint16_t rowPins, uint16_t colPins, KEYPAD_GPIO_MODE keypadMode) {
 	GPIO_InitTypeDef 	GPIO_InitStruct;
 
-	RCC_APB2PeriphClockCmd(KEYPAD_CLK, ENABLE);
+	RCC_APB2PeriphClockCmd(clk, ENABLE);
 
 	switch (keypadMode) {
 		case ROW_IN_COL_OUT:
 			GPIO_InitStruct.GPIO_Speed = GPIO_Speed_2MHz;
-			GPIO_InitStruct.GPIO_Pin = KEYPAD_ROW1 | KEYPAD_ROW2 | KEYPAD_ROW3 | KEYPAD_ROW4;
+			GPIO_InitStruct.GPIO_Pin = rowPins;
 			GPIO_InitStruct.GPIO_Mode = GPIO_Mode_IPU;
-			GPIO_Init(KEYPAD_PORT, &GPIO_InitStruct);
+			GPIO_Init(port, &GPIO_InitStruct);
 
-			GPIO_InitStruct.GPIO_Pin = KEYPAD_COL1 | KEYPAD_COL2 | KEYPAD_COL3 | KEYPAD_COL4;
+			GPIO_InitStruct.GPIO_Pin = colPins;
 			GPIO_InitStruct.GPIO_Mode = GPIO_Mode_Out_PP;
-			GPIO_Init(KEYPAD_PORT, &GPIO_InitStruct);
+			GPIO_Init(port, &GPIO_InitStruct);
 													// Set all output pins to low
-			GPIO_ResetBits(KEYPAD_PORT, KEYPAD_COL1 | KEYPAD_COL2 | KEYPAD_COL3 | KEYPAD_COL4);
+			GPIO_ResetBits(port, colPins);
 			break;
 
 		case ROW_OUT_COL_IN:
 			GPIO_InitStruct.GPIO_Speed = GPIO_Speed_2MHz;
-			GPIO_InitStruct.GPIO_Pin = KEYPAD_COL1 | KEYPAD_COL2 | KEYPAD_COL3 | KEYPAD_COL4;
+			GPIO_InitStruct.GPIO_Pin = colPins;
 			GPIO_InitStruct.GPIO_Mode = GPIO_Mode_IPU;
-			GPIO_Init(KEYPAD_PORT, &GPIO_InitStruct);
+			GPIO_Init(port, &GPIO_InitStruct);
 
-			GPIO_InitStruct.GPIO_Pin = KEYPAD_ROW1 | KEYPAD_ROW2 | KEYPAD_ROW3 | KEYPAD_ROW4;
+			GPIO_InitStruct.GPIO_Pin = rowPins;
 			GPIO_InitStruct.GPIO_Mode = GPIO_Mode_Out_PP;
-			GPIO_Init(KEYPAD_PORT, &GPIO_InitStruct);
+			GPIO_Init(port, &GPIO_InitStruct);
 													// Set all output pins to low
-			GPIO_ResetBits(KEYPAD_PORT, KEYPAD_ROW1 | KEYPAD_ROW2 | KEYPAD_ROW3 | KEYPAD_ROW4);
+			GPIO_ResetBits(port, rowPins);
 			break;
 
 		default:
@@ -8,8 +8,18 @@
 #ifndef GPIO_H_
 #define GPIO_H_
 
+/*
+ * Number of matrix keypads connected. The first one is wired as described in main.c, the second one (if any) uses
+ * PA1-4 for the rows and PA5-8 for the columns. PA0 is left to the user button B1 of the Discovery board, which would
+ * short a row driven low to VDD. More keypads can be added to keypadConfigs[] in buttons.c.
+ */
+#ifndef NUM_KEYPADS
+#define NUM_KEYPADS		1
+#endif
+
 #define KEYPAD_PORT		GPIOB
 #define KEYPAD_CLK		RCC_APB2Periph_GPIOB
+#define KEYPAD_PORTSOURCE	GPIO_PortSourceGPIOB
 
 #define LED_PORT		GPIOC
 #define LED_CLK			RCC_APB2Periph_GPIOC
@@ -24,9 +34,35 @@
 #define KEYPAD_COL3		GPIO_Pin_14
 #define KEYPAD_COL4		GPIO_Pin_15
 
+#define KEYPAD2_PORT		GPIOA
+#define KEYPAD2_CLK			RCC_APB2Periph_GPIOA
+#define KEYPAD2_PORTSOURCE	GPIO_PortSourceGPIOA
+
+#define KEYPAD2_ROW1		GPIO_Pin_1
+#define KEYPAD2_ROW2		GPIO_Pin_2
+#define KEYPAD2_ROW3		GPIO_Pin_3
+#define KEYPAD2_ROW4		GPIO_Pin_4
+
+#define KEYPAD2_COL1		GPIO_Pin_5
+#define KEYPAD2_COL2		GPIO_Pin_6
+#define KEYPAD2_COL3		GPIO_Pin_7
+#define KEYPAD2_COL4		GPIO_Pin_8
+
 #define LED_BLUE_PIN	GPIO_Pin_8
 #define LED_GREEN_PIN	GPIO_Pin_9
 
+#define UART_PORT		GPIOA			// USART1 TX used to stream the key events to a host
+#define UART_CLK		RCC_APB2Periph_GPIOA
+#define UART_TX_PIN		GPIO_Pin_9
+
+/*
+ * Single pin resistor-ladder keypad, used instead of the matrix above when KEYPAD_ENGINE_ADC is defined
+ */
+#define LADDER_PORT			GPIOA
+#define LADDER_CLK			RCC_APB2Periph_GPIOA
+#define LADDER_PIN			GPIO_Pin_1
+#define LADDER_ADC_CHANNEL	ADC_Channel_1
+
 /*
  * To identify the key that the user pressed among the 16 keys of the 4x4 keypad.
  * We will be changing the way we interface with the keypad. It can be row as pull-up inputs with falling edge interrupt, and
@@ -35,7 +71,9 @@
 typedef enum {ROW_IN_COL_OUT, ROW_OUT_COL_IN} KEYPAD_GPIO_MODE;
 
 void GPIO_SetAllAnalogInput(void);
-void GPIO_ConfigKeyPad(KEYPAD_GPIO_MODE mode);
+void GPIO_ConfigKeyPad(GPIO_TypeDef *port, uint32_t clk, uint16_t rowPins, uint16_t colPins, KEYPAD_GPIO_MODE mode);
 void GPIO_ConfigDiscoveryLEDs(void);
+void GPIO_ConfigUART(void);
+void GPIO_ConfigLadder(void);
 
 #endif /* GPIO_H_ */
@@ -0,0 +1,88 @@
+/*
+ * health.c
+ *
+ *  Author: Ahmed Talaat (aa_talaat@yahoo.com)
+ *
+ * Contact health of the matrix keypads, to replace the worn panels before they produce phantom or missed keys.
+ *
+ * The EXTI lines of a keypad stay enabled during its debounce window: every extra edge only increments a counter and
+ * latches the TIM4 counter (a few cycles, see keypadExtiDispatch in stm32f10x_it.c). When the window expires, the
+ * bottom half hands the edge count and the bounce duration of the transition over to Health_Record(), once per press
+ * and once per release.
+ *
+ * When the average bounce of a key goes above HEALTH_CHATTER_EDGES or HEALTH_CHATTER_MS, a MSG_KEY_CHATTER message is
+ * posted once with the key matrix index as content. It is posted again only if the key gets back below half the
+ * thresholds first. The statistics are read on request with Health_Get(), or with the debugger (keyHealth).
+ */
+
+#include "stm32f10x.h"
+#include "health.h"
+
+keyHealth_t	keyHealth[NUM_KEYPADS][16];
+
+static uint16_t ewma(uint16_t average, uint8_t sample);
+
+/*
+ * Account one debounced transition of a key. Called from the keypad bottom half.
+ */
+void Health_Record(uint8_t deviceID, uint8_t keyIndex, uint8_t pressed, uint8_t bounceEdges, uint8_t bounceMs) {
+	keyHealth_t	*health = &keyHealth[deviceID][keyIndex & 0x0F];
+	msgQueueDef	msg;
+
+	if (pressed && (health->presses != 0xFFFF)) {
+		health->presses++;
+	}
+	if (bounceMs > health->bounceMsMax) {
+		health->bounceMsMax = bounceMs;
+	}
+	if (((bounceEdges > HEALTH_CHATTER_EDGES) || (bounceMs > HEALTH_CHATTER_MS)) && (health->chatters != 0xFFFF)) {
+		health->chatters++;
+	}
+	health->bounceEdgesAvg = ewma(health->bounceEdgesAvg, bounceEdges);
+	health->bounceMsAvg = ewma(health->bounceMsAvg, bounceMs);
+
+	if ((health->bounceEdgesAvg > (HEALTH_CHATTER_EDGES << 8)) || (health->bounceMsAvg > (HEALTH_CHATTER_MS << 8))) {
+		if (!(health->flags & HEALTH_REPORTED)) {
+			health->flags |= HEALTH_REPORTED;
+			msg.msgID = MSG_KEY_CHATTER;
+			msg.deviceID = deviceID;
+			msg.msgContent = keyIndex;
+			msg.keyIndex = keyIndex;
+			putItemInQueue(&IsrToMainQueue, &msg);
+		}
+	} else if ((health->bounceEdgesAvg < (HEALTH_CHATTER_EDGES << 7)) && (health->bounceMsAvg < (HEALTH_CHATTER_MS << 7))) {
+		health->flags &= ~HEALTH_REPORTED;
+	}
+}
+
+/*
+ * Statistics of one key of a keypad
+ */
+const keyHealth_t *Health_Get(uint8_t deviceID, uint8_t keyIndex) {
+	return &keyHealth[deviceID][keyIndex & 0x0F];
+}
+
+/*
+ * Clear the statistics of a keypad, e.g. after its panel was replaced
+ */
+void Health_Reset(uint8_t deviceID) {
+	uint8_t	key;
+
+	for (key = 0; key < 16; key++) {
+		keyHealth[deviceID][key].presses = 0;
+		keyHealth[deviceID][key].chatters = 0;
+		keyHealth[deviceID][key].bounceEdgesAvg = 0;
+		keyHealth[deviceID][key].bounceMsAvg = 0;
+		keyHealth[deviceID][key].bounceMsMax = 0;
+		keyHealth[deviceID][key].flags = 0;
+	}
+}
+
+/*
+ * average += (sample - average) / 8, in 8.8 fixed point. The result stays below 255 << 8, so it cannot overflow.
+ */
+static uint16_t ewma(uint16_t average, uint8_t sample) {
+	int32_t	delta = ((int32_t) sample << 8) - average;
+
+	return (uint16_t) (average + (delta >> HEALTH_EWMA_SHIFT));
+}
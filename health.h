@@ -0,0 +1,38 @@
+/*
+ * health.h
+ *
+ *  Author: Ahmed Talaat (aa_talaat@yahoo.com)
+ */
+
+#ifndef HEALTH_H_
+#define HEALTH_H_
+
+#include "gpio.h"
+#include "queues.h"
+
+#define HEALTH_EWMA_SHIFT		3			// weight of a new sample in the averages: 1/8
+#define HEALTH_CHATTER_EDGES	6			// average bounce edges per transition above which a key is reported
+#define HEALTH_CHATTER_MS		10			// average bounce duration (ms) above which a key is reported
+
+#define HEALTH_REPORTED			0x01		// keyHealth_t flags: MSG_KEY_CHATTER already posted for this key
+
+/*
+ * Contact statistics of one key. The averages are exponentially weighted, in 8.8 fixed point, and all the counters
+ * saturate instead of wrapping.
+ */
+typedef struct keyHealth_s {
+	uint16_t	presses;					// confirmed presses
+	uint16_t	chatters;					// transitions that bounced longer or more than the chatter thresholds
+	uint16_t	bounceEdgesAvg;				// extra edges per transition (press and release), 8.8
+	uint16_t	bounceMsAvg;				// time from the first to the last edge of a transition in ms, 8.8
+	uint8_t		bounceMsMax;				// worst bounce duration seen, in ms
+	uint8_t		flags;
+} keyHealth_t;
+
+extern keyHealth_t	keyHealth[NUM_KEYPADS][16];		// indexed by keypad id and key matrix index (4*row+col)
+
+void Health_Record(uint8_t deviceID, uint8_t keyIndex, uint8_t pressed, uint8_t bounceEdges, uint8_t bounceMs);
+const keyHealth_t *Health_Get(uint8_t deviceID, uint8_t keyIndex);
+void Health_Reset(uint8_t deviceID);
+
+#endif /* HEALTH_H_ */
@@ -0,0 +1,157 @@
+/*
+ * adcsim.c
+ *
+ *  Author: Ahmed Talaat (aa_talaat@yahoo.com)
+ *
+ * Host simulation of the resistor-ladder keypad engine (ladder.c). A synthetic ADC sample stream is generated for a
+ * sequence of key presses and fed to processLadderSamples() in blocks of ADC_KEYPAD_BUFFER_SIZE/2 samples, as the DMA
+ * ISR does on the target. After each block the queue is drained like the main loop would, and the decoded keys are
+ * compared with the pressed ones.
+ *
+ * The stream models what the ADC sees on a real panel:
+ *	- Gaussian noise on every sample.
+ *	- An RC settle when the level changes, so the samples sweep through the windows of the keys in between.
+ *	- Contact bounce: random drops back to the released level during the first milliseconds of a press and a release.
+ *
+ * Usage: adcsim [presses] [noise_lsb] [bounce_ms] [seed]
+ * Prints a JSON summary and returns 0 when every key was decoded once with no phantom or missed key.
+ *
+ * Build: gcc -O2 -I. -I.. -o adcsim adcsim.c ../ladder.c ../queues.c -lm
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <time.h>
+
+#include "stm32f10x.h"
+#include "queues.h"
+#include "ladder.h"
+#include "adc_keypad.h"
+
+static const uint8_t	keyMap[16]={'1','2','3','A',			// base layer of keymap.c
+					'4','5','6','B',
+					'7','8','9','C',
+					'*','0','#','D'};
+
+#define LEVEL(k)		((k) == LADDER_RELEASED ? 4095.0 : 256.0*(k))
+#define RC_TAU_MS		1.5
+
+/*
+ * The sample blocks are fed from main(), no ISR runs: the critical sections of queues.c have nothing to mask
+ */
+uint32_t __get_PRIMASK(void) {
+	return 0;
+}
+
+void __disable_irq(void) {
+}
+
+void __set_PRIMASK(uint32_t priMask) {
+}
+
+static double gaussian(void) {
+	double u1 = (rand() + 1.0) / (RAND_MAX + 2.0), u2 = (rand() + 1.0) / (RAND_MAX + 2.0);
+
+	return sqrt(-2.0*log(u1)) * cos(2.0*M_PI*u2);
+}
+
+typedef struct adcStream_s {
+	uint16_t	block[ADC_KEYPAD_BUFFER_SIZE/2];
+	uint8_t		fill;
+	double		level;							// analog level at the pin, follows the target with an RC time constant
+	double		noise;
+	uint32_t	samples;
+	uint8_t		expected[4096];
+	uint32_t	nExpected;
+	uint8_t		decoded[4096];
+	uint32_t	nDecoded;
+	uint32_t	ups;
+	double		cpuNs;
+} adcStream_t;
+
+/*
+ * One sample per ms. The block is handed over to the engine when full, then the queue is drained.
+ */
+static void emitSample(adcStream_t *s, double target) {
+	msgQueueDef		msg;
+	struct timespec	t0, t1;
+	double			v;
+
+	s->level += (target - s->level) * (1.0 - exp(-1.0 / RC_TAU_MS));
+	v = s->level + s->noise * gaussian();
+	s->block[s->fill++] = (uint16_t) (v < 0 ? 0 : (v > 4095 ? 4095 : v));
+	s->samples++;
+
+	if (s->fill == ADC_KEYPAD_BUFFER_SIZE/2) {
+		clock_gettime(CLOCK_MONOTONIC, &t0);
+		processLadderSamples(&ladderState, s->block, s->fill);
+		clock_gettime(CLOCK_MONOTONIC, &t1);
+		s->cpuNs += (t1.tv_sec - t0.tv_sec) * 1e9 + (t1.tv_nsec - t0.tv_nsec);
+		s->fill = 0;
+
+		while (getItemFromQueue(&IsrToMainQueue, &msg) != 0xFF) {
+			if (msg.msgID == MSG_BT_DOWN && s->nDecoded < sizeof s->decoded) {
+				s->decoded[s->nDecoded++] = msg.msgContent;
+			} else if (msg.msgID == MSG_BT_UP) {
+				s->ups++;
+			}
+		}
+	}
+}
+
+/*
+ * Hold a level for some ms, with bounce to the released level during the first bounceMs
+ */
+static void hold(adcStream_t *s, uint8_t keyClass, int ms, int bounceMs) {
+	int t;
+
+	for (t = 0; t < ms; t++) {
+		if (t < bounceMs && (rand() & 3) == 0) {
+			emitSample(s, LEVEL(LADDER_RELEASED));
+		} else {
+			emitSample(s, LEVEL(keyClass));
+		}
+	}
+}
+
+int main(int argc, char **argv) {
+	static adcStream_t	s;
+	int					presses = argc > 1 ? atoi(argv[1]) : 1000;
+	int					bounceMs = argc > 3 ? atoi(argv[3]) : 3;
+	uint32_t			i, j, missed = 0, phantom = 0;
+	uint8_t				key;
+
+	s.noise = argc > 2 ? atof(argv[2]) : 20.0;
+	srand(argc > 4 ? atoi(argv[4]) : 1);
+	s.level = LEVEL(LADDER_RELEASED);
+
+	initializeQueue(&IsrToMainQueue);
+	initializeLadder(&ladderState, keyMap);
+
+	for (i = 0; i < (uint32_t) presses && s.nExpected < sizeof s.expected; i++) {
+		key = rand() % LADDER_KEYS;
+		s.expected[s.nExpected++] = keyMap[key];
+		hold(&s, LADDER_RELEASED, 30 + rand() % 200, bounceMs);	// idle between presses
+		hold(&s, key, 40 + rand() % 150, bounceMs);				// key down
+	}
+	hold(&s, LADDER_RELEASED, 100, bounceMs);
+
+	for (i = 0, j = 0; i < s.nExpected || j < s.nDecoded; ) {	// greedy alignment of decoded against pressed keys
+		if (i < s.nExpected && j < s.nDecoded && s.decoded[j] == s.expected[i]) {
+			i++;
+			j++;
+		} else if (j < s.nDecoded && (i >= s.nExpected || (j+1 < s.nDecoded && s.decoded[j+1] == s.expected[i]))) {
+			phantom++;
+			j++;
+		} else {
+			missed++;
+			i++;
+		}
+	}
+
+	printf("{\"presses\": %u, \"decoded\": %u, \"releases\": %u, \"phantom\": %u, \"missed\": %u, "
+		   "\"samples\": %u, \"noise_lsb\": %.1f, \"bounce_ms\": %d, \"ns_per_sample\": %.2f}\n",
+		   s.nExpected, s.nDecoded, s.ups, phantom, missed, s.samples, s.noise, bounceMs, s.cpuNs / s.samples);
+
+	return (missed == 0 && phantom == 0 && s.ups == s.nExpected) ? 0 : 1;
+}
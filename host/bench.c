@@ -0,0 +1,286 @@
+/*
+ * bench.c
+ *
+ *  Author: Ahmed Talaat (aa_talaat@yahoo.com)
+ *
+ * Benchmarks of the hot paths of the keypad firmware, built on the host against the peripheral models of stm32sim.c:
+ *	- queue:	putItemInQueue then getItemFromQueue, one message.
+ *	- decode:	getKeyPressed of a pressed key, then the pins set back to wait for the next key, as the bottom half does.
+ *	- debounce:	one transition of a key bouncing BENCH_BOUNCE_EDGES times, through the EXTI, TIM4 and PendSV handlers
+ *				up to the handlers of the message in the main loop (firmware.c). Also reported in target cycles per
+ *				transition of the keypad handlers, from the costs of the simulator (simIrqCycles): these are estimates,
+ *				not measures, hence the _est suffix. irq_latency_max_us_est is the time one TIM4 call holds off the
+ *				interrupts of lower preemption priority (the USART1 DMA one): the whole decoding with
+ *				KEYPAD_TOP_HALF_DECODE, the latch only otherwise. Only a KEYPAD_PROFILE build on the target measures it.
+ *	- flows:	one key given to the flow engine running the flows of app.c (checkPassword before the flows).
+ *	- dispatch:	one message, a key down then a key up, through dispatchMessage and the handlers of dispatch_table.h.
+ *	- switch:	the same messages and handlers, called from a switch on the MSGID as the main loop did before
+ *				dispatch.c: the difference with dispatch is the cost of the table.
+ *
+ * Each benchmark runs its fixed number of iterations BENCH_RUNS times, and the best run is reported in ns per operation,
+ * to compare two builds on the same machine. The host numbers of decode and debounce include the peripheral models.
+ *
+ * Usage: bench [firmware.elf]
+ * Prints JSON. Given the firmware image, its flash and RAM use are added from the ELF section headers (the RAM includes
+ * the stack reserved by the linker script).
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <elf.h>
+
+#include "stm32f10x.h"
+#include "stm32sim.h"
+#include "queues.h"
+#include "buttons.h"
+#include "flow.h"
+#include "gpio.h"
+#include "firmware.h"
+#include "dispatch.h"
+#include "dispatch_table.h"
+
+#define BENCH_RUNS			5
+#define BENCH_BOUNCE_EDGES	6
+
+typedef struct benchResult_s {
+	const char	*name;
+	uint32_t	iterations;
+	double		bestNs;					// per operation, best run
+	double		medianNs;				// per operation, median run
+} benchResult_t;
+
+static volatile uint32_t	sink;		// results of the benchmarks, so that nothing is optimized away
+
+static double nowNs(void) {
+	struct timespec	ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static int compareDouble(const void *a, const void *b) {
+	double	x = *(const double *) a, y = *(const double *) b;
+
+	return (x > y) - (x < y);
+}
+
+/*
+ * Run a benchmark body BENCH_RUNS times
+ */
+static benchResult_t measure(const char *name, uint32_t iterations, void (*setup)(void), void (*body)(uint32_t)) {
+	benchResult_t	result = {name, iterations, 0, 0};
+	double			runs[BENCH_RUNS], start;
+	uint8_t			i;
+
+	for (i = 0; i < BENCH_RUNS; i++) {
+		if (setup) {
+			setup();
+		}
+		start = nowNs();
+		body(iterations);
+		runs[i] = (nowNs() - start) / iterations;
+	}
+	qsort(runs, BENCH_RUNS, sizeof runs[0], compareDouble);
+	result.bestNs = runs[0];
+	result.medianNs = runs[BENCH_RUNS / 2];
+	return result;
+}
+
+/* queue ----------------------------------------------------------------------*/
+static void queueSetup(void) {
+	initializeQueue(&IsrToMainQueue);
+}
+
+static void queueBody(uint32_t n) {
+	msgQueueDef	in = {MSG_BT_DOWN, 0, 0}, out;
+	uint32_t	i;
+
+	for (i = 0; i < n; i++) {
+		in.msgContent = (uint8_t) i;
+		putItemInQueue(&IsrToMainQueue, &in);
+		getItemFromQueue(&IsrToMainQueue, &out);
+		sink += out.msgContent;
+	}
+}
+
+/* decode and debounce --------------------------------------------------------*/
+static void observe(msgQueueDef *msg) {
+	sink += msg->msgContent;
+}
+
+static void keypadSetup(void) {
+	firmwareObserver = observe;
+	Firmware_Start();
+}
+
+static void decodeSetup(void) {
+	keypadSetup();
+	simOnInterrupt = 0;
+	simSetContact(0, 6, 1);					// row 1, column 2, held
+	simEXTI.PR = 0;
+}
+
+static void decodeBody(uint32_t n) {
+	uint32_t	i;
+
+	for (i = 0; i < n; i++) {
+		sink += getKeyPressed(&keypads[0], 2);
+		Config_Keypad(&keypads[0], ROW_OUT_COL_IN);
+	}
+}
+
+/*
+ * One transition of key (i % 16), bouncing then settled, and the debounce delay run out
+ */
+static void debounceBody(uint32_t n) {
+	uint32_t	i;
+	uint8_t		edge, key, closed;
+
+	for (i = 0; i < n; i++) {
+		key = (i / 2) % 16;
+		closed = !(i & 1);
+		for (edge = 0; edge <= BENCH_BOUNCE_EDGES; edge++) {
+			simSetContact(0, key, (edge & 1) ? !closed : closed);
+			simAdvance(simNow + 200 * SIM_US);
+		}
+		simAdvance(simNow + 25 * SIM_MS);
+	}
+}
+
+/* flows ----------------------------------------------------------------------*/
+static void flowsBody(uint32_t n) {
+	static const uint8_t	keys[] = "12341235123412";
+	msgQueueDef				msg = {MSG_BT_DOWN, 0, 0};
+	uint32_t				i;
+
+	for (i = 0; i < n; i++) {
+		msg.msgContent = keys[i % (sizeof keys - 1)];
+		Flow_OnKeyDown(&msg);
+	}
+	sink += LED_PORT->ODR;					// toggled by the password flow
+}
+
+/* dispatch and switch --------------------------------------------------------*/
+#define BENCH_DECLARE(handler)			uint8_t handler(msgQueueDef *theMsg);
+#define BENCH_DECLARE_LIST(msgID)		msgID##_SUBSCRIBERS(BENCH_DECLARE)
+DISPATCH_MESSAGES(BENCH_DECLARE_LIST)
+
+#define BENCH_CALL(handler)				if (handler(msg) == DISPATCH_STOP) { break; }
+#define BENCH_CASE(msgID)				case msgID: do { msgID##_SUBSCRIBERS(BENCH_CALL) } while (0); break;
+
+static void switchMessage(msgQueueDef *msg) {
+	switch (msg->msgID) {
+		DISPATCH_MESSAGES(BENCH_CASE)
+		default:
+			break;
+	}
+}
+
+static void messagesBody(uint32_t n, void (*deliver)(msgQueueDef *)) {
+	msgQueueDef	down = {MSG_BT_DOWN, 0, '5'}, up = {MSG_BT_UP, 0, 1};
+	uint32_t	i;
+
+	for (i = 0; i < n; i += 2) {
+		deliver(&down);
+		deliver(&up);
+	}
+	sink += LED_PORT->ODR;
+}
+
+static void dispatchBody(uint32_t n) {
+	messagesBody(n, dispatchMessage);
+}
+
+static void switchBody(uint32_t n) {
+	messagesBody(n, switchMessage);
+}
+
+/* Firmware image -------------------------------------------------------------*/
+
+/*
+ * Flash and RAM use of an ARM ELF image, from its allocated sections. Returns 0, or -1 if it is not one.
+ */
+static int firmwareSizes(const char *path, uint32_t *text, uint32_t *data, uint32_t *bss) {
+	FILE		*f = fopen(path, "rb");
+	Elf32_Ehdr	eh;
+	Elf32_Shdr	sh;
+	uint16_t	i;
+
+	*text = *data = *bss = 0;
+	if (f == NULL) {
+		return -1;
+	}
+	if ((fread(&eh, sizeof eh, 1, f) != 1) || memcmp(eh.e_ident, ELFMAG, SELFMAG) ||
+		(eh.e_ident[EI_CLASS] != ELFCLASS32) || (eh.e_machine != EM_ARM)) {
+		fclose(f);
+		return -1;
+	}
+	for (i = 0; i < eh.e_shnum; i++) {
+		if (fseek(f, eh.e_shoff + (long) i * eh.e_shentsize, SEEK_SET) || (fread(&sh, sizeof sh, 1, f) != 1)) {
+			fclose(f);
+			return -1;
+		}
+		if (!(sh.sh_flags & SHF_ALLOC)) {
+			continue;
+		}
+		if (sh.sh_type == SHT_NOBITS) {
+			*bss += sh.sh_size;
+		} else if (sh.sh_flags & SHF_WRITE) {
+			*data += sh.sh_size;
+		} else {
+			*text += sh.sh_size;
+		}
+	}
+	fclose(f);
+	return 0;
+}
+
+int main(int argc, char *argv[]) {
+	benchResult_t	results[6];
+	uint32_t		transitions, i, text, data, bss;
+	uint64_t		cycles = 0;
+	uint8_t			adaptive = 0;
+
+#ifdef KEYPAD_ADAPTIVE_DEBOUNCE
+	adaptive = 1;
+#endif
+	results[0] = measure("queue", 10000000, queueSetup, queueBody);
+	results[1] = measure("decode", 200000, decodeSetup, decodeBody);
+	results[2] = measure("debounce", 20000, keypadSetup, debounceBody);
+
+	keypadSetup();									// target cycles of the debounce path, in one more run
+	transitions = 2000;
+	debounceBody(transitions);
+	for (i = 0; i < SIM_IRQ_COUNT; i++) {
+		if ((i == SIM_IRQ_TIM4) || (i == SIM_IRQ_EXTI9_5) || (i == SIM_IRQ_EXTI15_10) || (i == SIM_IRQ_PENDSV)) {
+			cycles += (uint64_t) simStats.irqCount[i] * simIrqCycles[i];
+		}
+	}
+
+	results[3] = measure("flows", 10000000, keypadSetup, flowsBody);
+	results[4] = measure("dispatch", 2000000, keypadSetup, dispatchBody);
+	results[5] = measure("switch", 2000000, keypadSetup, switchBody);
+
+	printf("{\"compiler\": \"%s\", \"adaptive\": %u, \"runs\": %u, \"benchmarks\": {", __VERSION__, adaptive, BENCH_RUNS);
+	for (i = 0; i < 6; i++) {
+		printf("%s\"%s\": {\"iterations\": %u, \"ns_per_op\": %.2f, \"ns_per_op_median\": %.2f, \"ops_per_s\": %.0f",
+			   i ? ", " : "", results[i].name, results[i].iterations, results[i].bestNs, results[i].medianNs,
+			   1e9 / results[i].bestNs);
+		if (i == 2) {
+			printf(", \"target_cycles_per_transition_est\": %.1f, \"tim4_cycles_est\": %u, \"irq_latency_max_us_est\": %.1f",
+				   (double) cycles / transitions, simIrqCycles[SIM_IRQ_TIM4],
+				   simIrqCycles[SIM_IRQ_TIM4] * 1e6 / SystemCoreClock);
+		}
+		printf("}");
+	}
+	printf("}, \"firmware\": ");
+	if (argc > 1 && firmwareSizes(argv[1], &text, &data, &bss) == 0) {
+		printf("{\"image\": \"%s\", \"text\": %u, \"data\": %u, \"bss\": %u, \"flash\": %u, \"ram\": %u}",
+			   argv[1], text, data, bss, text + data, data + bss);
+	} else {
+		printf("null");
+	}
+	printf("}\n");
+	return 0;
+}
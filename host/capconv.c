@@ -0,0 +1,206 @@
+/*
+ * capconv.c
+ *
+ *  Author: Ahmed Talaat (aa_talaat@yahoo.com)
+ *
+ * Converts the CSV export of a logic analyzer capture of PB8-PB15 (the keypad port) to the binary edge format of
+ * capture.h, for capreplay.
+ *
+ * The CSV is read one line at a time, so the size of the export does not matter: a header line, then one line per
+ * sample or per change, with the time in seconds first and then either the 8 lines in the order PB8 to PB15 (0 or 1
+ * each), or the 8 lines as one value (bit 0 = PB8, decimal or 0x hexadecimal). ',', ';', tabs and spaces separate the
+ * fields. A line longer than MAX_LINE cannot be a sample, and is skipped whole (long_lines). The samples where no line
+ * changed are dropped, and the times are rounded to the resolution (10 ns by default, a whole number of ns). The
+ * capture starts at the time of its first sample.
+ *
+ * Usage: capconv capture.csv capture.kpe [resolution_ns]
+ * Prints a JSON summary. Returns 2 if a file cannot be opened, read or written (e.g. a full disk), 1 if the CSV has no
+ * sample or goes back in time.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <sys/types.h>
+
+#include "capture.h"
+
+#define MAX_LINE		1024
+
+static captureIndex_t	*index_;
+static uint64_t			nIndex, maxIndex;
+
+/*
+ * Parses the levels of a sample after the time. Returns 1, or 0 if the line has no levels.
+ */
+static uint8_t parseLevels(char *s, uint8_t *levels) {
+	char		*end;
+	long		value[8];
+	uint8_t		n = 0, i;
+
+	while (n < 8) {
+		while (*s == ',' || *s == ';' || isspace((unsigned char) *s)) {
+			s++;
+		}
+		if (*s == 0) {
+			break;
+		}
+		value[n] = strtol(s, &end, 0);
+		if (end == s) {
+			return 0;
+		}
+		s = end;
+		n++;
+	}
+	if (n == 1) {
+		*levels = (uint8_t) value[0];
+	} else if (n == 8) {
+		for (*levels = 0, i = 0; i < 8; i++) {
+			*levels |= (value[i] != 0) << i;
+		}
+	} else {
+		return 0;
+	}
+	return 1;
+}
+
+static void addIndex(uint64_t ticks, uint64_t offset, uint64_t record, uint8_t levels) {
+	if (nIndex == maxIndex) {
+		maxIndex = maxIndex ? 2 * maxIndex : 1024;
+		index_ = realloc(index_, maxIndex * sizeof *index_);
+	}
+	memset(&index_[nIndex], 0, sizeof index_[nIndex]);
+	index_[nIndex].ticks = ticks;
+	index_[nIndex].offset = offset;
+	index_[nIndex].record = record;
+	index_[nIndex].levels = levels;
+	nIndex++;
+}
+
+static int writeFailed(const char *path) {
+	fprintf(stderr, "capconv: cannot write %s\n", path);
+	return 2;
+}
+
+static uint8_t writeVarint(uint8_t *out, uint64_t value) {
+	uint8_t	n = 0;
+
+	while (value >= 0x80) {
+		out[n++] = (uint8_t) value | 0x80;
+		value >>= 7;
+	}
+	out[n++] = (uint8_t) value;
+	return n;
+}
+
+int main(int argc, char *argv[]) {
+	captureHeader_t	header;
+	FILE			*in, *out;
+	char			line[MAX_LINE], *s, *end = "";
+	uint8_t			record[11], levels, last = 0, n;
+	uint64_t		ticks, lastTicks = 0, offset, dataBytes, lines = 0, samples = 0, csvBytes = 0, longLines = 0;
+	size_t			length;
+	unsigned long	resolution = 10;
+	double			t, t0 = 0;
+
+	if (argc > 3) {
+		errno = 0;
+		resolution = isdigit((unsigned char) argv[3][0]) ? strtoul(argv[3], &end, 10) : 0;
+	}
+	if (argc < 3 || resolution < 1 || resolution > UINT32_MAX || errno || *end) {
+		fprintf(stderr, "usage: capconv capture.csv capture.kpe [resolution_ns]\n");
+		return 2;
+	}
+	in = fopen(argv[1], "r");
+	out = fopen(argv[2], "wb");
+	if (in == NULL || out == NULL) {
+		fprintf(stderr, "capconv: cannot open %s\n", in == NULL ? argv[1] : argv[2]);
+		return 2;
+	}
+
+	memset(&header, 0, sizeof header);
+	memcpy(header.magic, CAPTURE_MAGIC, 4);
+	header.version = CAPTURE_VERSION;
+	header.tickNs = (uint32_t) resolution;
+	header.indexStride = CAPTURE_INDEX_STRIDE;
+	header.dataOffset = sizeof header;
+	if (fwrite(&header, sizeof header, 1, out) != 1) {		// completed at the end
+		return writeFailed(argv[2]);
+	}
+	offset = sizeof header;
+
+	while (fgets(line, sizeof line, in) != NULL) {
+		length = strlen(line);
+		csvBytes += length;
+		lines++;
+		if ((length == sizeof line - 1) && (line[length - 1] != '\n') && !feof(in)) {
+			do {											// too long for a sample: skip the rest of it
+				if (fgets(line, sizeof line, in) == NULL) {
+					break;
+				}
+				length = strlen(line);
+				csvBytes += length;
+			} while (line[length - 1] != '\n');
+			longLines++;
+			continue;
+		}
+		t = strtod(line, &s);
+		if (s == line || !parseLevels(s, &levels)) {
+			continue;										// header or comment
+		}
+		if (samples++ == 0) {
+			t0 = t;
+			last = header.initialLevels = levels;
+			continue;
+		}
+		ticks = (uint64_t) ((t - t0) * 1e9 / resolution + 0.5);
+		if (t < t0 || ticks < lastTicks) {
+			fprintf(stderr, "capconv: time goes back at line %llu\n", (unsigned long long) lines);
+			return 1;
+		}
+		if (levels == last) {
+			continue;
+		}
+		if (header.records % CAPTURE_INDEX_STRIDE == 0) {
+			addIndex(lastTicks, offset, header.records, last);
+		}
+		n = writeVarint(record, ticks - lastTicks);
+		record[n++] = levels;
+		if (fwrite(record, 1, n, out) != n) {
+			return writeFailed(argv[2]);
+		}
+		offset += n;
+		header.records++;
+		lastTicks = ticks;
+		last = levels;
+	}
+	if (ferror(in)) {
+		fprintf(stderr, "capconv: cannot read %s\n", argv[1]);
+		return 2;
+	}
+	fclose(in);
+	if (samples == 0) {
+		fprintf(stderr, "capconv: no sample in %s\n", argv[1]);
+		return 1;
+	}
+
+	dataBytes = offset - sizeof header;
+	offset = (offset + 7) & ~7ULL;							// the index is aligned for the mapped reads
+	header.endTicks = lastTicks;
+	header.indexOffset = offset;
+	header.indexEntries = nIndex;
+	if (fseeko(out, (off_t) offset, SEEK_SET) || (fwrite(index_, sizeof *index_, nIndex, out) != nIndex) ||
+		fseeko(out, 0, SEEK_SET) || (fwrite(&header, sizeof header, 1, out) != 1) || fclose(out)) {
+		return writeFailed(argv[2]);
+	}
+
+	printf("{\"samples\": %llu, \"records\": %llu, \"duration_s\": %.6f, \"csv_bytes\": %llu, \"kpe_bytes\": %llu, "
+		   "\"bytes_per_record\": %.2f, \"index_entries\": %llu, \"long_lines\": %llu}\n",
+		   (unsigned long long) samples, (unsigned long long) header.records, (double) lastTicks * resolution / 1e9,
+		   (unsigned long long) csvBytes, (unsigned long long) (offset + nIndex * sizeof *index_),
+		   header.records ? (double) dataBytes / header.records : 0.0, (unsigned long long) nIndex,
+		   (unsigned long long) longLines);
+	free(index_);
+	return 0;
+}
@@ -0,0 +1,350 @@
+/*
+ * capreplay.c
+ *
+ *  Author: Ahmed Talaat (aa_talaat@yahoo.com)
+ *
+ * Replays a logic analyzer capture of the keypad port (PB8-PB15, converted by capconv) on the firmware running over
+ * the peripheral models of stm32sim.c (main() modelled by firmware.c), and checks its debounce and scan decisions
+ * against the contacts of the capture.
+ *
+ * The file is mapped and its records read in place (capture.h), from the start or from the seek index entry before
+ * from_s: nothing is copied or loaded, and the time between the edges costs nothing to simulate, so hours of capture
+ * replay in seconds.
+ *
+ * The capture holds the lines as the board drove them, not the contacts, so these are rebuilt from the capture:
+ *	- While the rows are all low (ROW_OUT_COL_IN, the firmware waiting for a key), a column is low when one of its keys
+ *	  is closed. Its edges are the contact edges of the key, bounce included, and are played on the simulated matrix.
+ *	- Which key of the column: when the board scans (the column being decoded driven low, the rows read with their
+ *	  pull-ups), the row of the key is the low one. The first edge of a column looks ahead in the mapping, up to
+ *	  LOOKAHEAD_MS, for the scan of that column that follows it. The scans of a former firmware, driving all the columns
+ *	  low, are taken for the column of the contact. A column activity with no scan after it (noise on the wire, or a bounce too short for the
+ *	  board) is played as the column wire driven from outside, with no key behind it.
+ *	- The other states (the board switching its pins) are skipped.
+ *
+ * Ground truth: a key is pressed when its contact stayed closed TRUTH_HOLD_MS after its last edge. The keys decoded by
+ * the simulated firmware are aligned with the presses by time, as in keysim.c: decoded once with its key is matched,
+ * never decoded is missed, decoded with no press, a wrong key or twice is a phantom. The keys found by the scans of
+ * the board are also compared with the simulated ones (board).
+ *
+ * Usage: capreplay capture.kpe [from_s] [to_s]
+ * Prints a JSON summary and returns 0 when every press was decoded once with no phantom, 1 otherwise, 2 if the file
+ * is not a capture.
+ *
+ * Build with the firmware as keysim.c, plus capreplay.c (make tools).
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "stm32f10x.h"
+#include "stm32sim.h"
+#include "queues.h"
+#include "buttons.h"
+#include "keymap.h"
+#include "firmware.h"
+#include "capture.h"
+
+#define ROW_LINES		0x0F					// PB8-PB11 in the levels of a record
+#define COL_LINES		0xF0					// PB12-PB15
+#define SCAN_ALL		4						// scan column of a former firmware driving all the columns
+#define LOOKAHEAD_MS	100						// for the scan after the first edge of a column
+#define RUN_END_MS		10						// a column high that long ends the contact of a key
+#define TRUTH_HOLD_MS	30						// a contact closed that long after its last edge is a press
+#define MATCH_MS		200						// latest decode matched with a press
+#define BOARD_MS		5						// decode of the simulation matched with a scan of the board
+
+typedef struct keyList_s {
+	simTime_t	*t;
+	uint8_t		*key;
+	uint32_t	n, max;
+} keyList_t;
+
+/*
+ * A column of the capture while the board waits for a key
+ */
+typedef struct column_s {
+	uint8_t		low;
+	uint8_t		inRun;							// a contact (and its bounce) is being played on the column
+	int8_t		key;							// matrix index of the contact, -1 for a wire with no key
+	uint8_t		pressed;						// the run was taken as a press
+	simTime_t	runStart, lastEdge;
+} column_t;
+
+static keyList_t		truth, decoded, board;
+static column_t			columns[4];
+static uint8_t			*matched;
+static uint32_t			noiseRuns, noiseKeys;
+static captureHeader_t	*header;
+
+static void addKey(keyList_t *list, simTime_t t, uint8_t key) {
+	if (list->n == list->max) {
+		list->max = list->max ? 2 * list->max : 4096;
+		list->t = realloc(list->t, list->max * sizeof *list->t);
+		list->key = realloc(list->key, list->max);
+	}
+	list->t[list->n] = t;
+	list->key[list->n] = key;
+	list->n++;
+}
+
+/*
+ * Messages of the firmware main loop (firmware.c)
+ */
+static void observe(msgQueueDef *msg) {
+	if (msg->msgID == MSG_BT_DOWN && msg->msgContent == 0) {
+		noiseKeys++;
+	} else if (msg->msgID == MSG_BT_DOWN) {
+		addKey(&decoded, simNow, msg->msgContent);
+	}
+}
+
+/*
+ * Column driven low by a scan of the board, SCAN_ALL when they all are, -1 if the levels are not a scan: no row low
+ * (no key), or all of them (the board waiting for a key).
+ */
+static int8_t scanColumn(uint8_t levels) {
+	uint8_t	cols = ~levels & COL_LINES;
+
+	if (((levels & ROW_LINES) == 0) || ((levels & ROW_LINES) == ROW_LINES)) {
+		return -1;
+	}
+	if (cols == COL_LINES) {
+		return SCAN_ALL;
+	}
+	if (cols && !(cols & (cols - 1))) {
+		return __builtin_ctz(cols) - 4;
+	}
+	return -1;
+}
+
+static uint8_t lowRow(uint8_t levels) {
+	uint8_t	row;
+
+	for (row = 0; row < 3 && (levels & (1 << row)); row++);
+	return row;
+}
+
+/*
+ * Row of the key behind the first edge of a column: the low row of the next scan of the column by the board, if it
+ * comes within LOOKAHEAD_MS. Reads ahead in the mapping with a copy of the reader. Returns -1 if there is none.
+ */
+static int8_t lookAhead(const captureReader_t *r, uint8_t col) {
+	captureReader_t	ahead = *r;
+	uint64_t		limit = r->ticks + (uint64_t) LOOKAHEAD_MS * 1000000 / header->tickNs;
+	int8_t			scan;
+
+	while (Capture_Next(&ahead) && ahead.ticks <= limit) {
+		scan = scanColumn(ahead.levels);
+		if ((scan == col) || (scan == SCAN_ALL)) {
+			return lowRow(ahead.levels);
+		}
+	}
+	return -1;
+}
+
+/*
+ * Presses of the capture: contacts closed TRUTH_HOLD_MS after their last edge
+ */
+static void settle(simTime_t now) {
+	column_t	*c;
+	uint8_t		col;
+
+	for (col = 0; col < 4; col++) {
+		c = &columns[col];
+		if (c->inRun && c->low && !c->pressed && (c->key >= 0) && (now - c->lastEdge >= TRUTH_HOLD_MS * SIM_MS)) {
+			c->pressed = 1;
+			addKey(&truth, c->runStart, keypads[0].keyMap[c->key]);
+		}
+	}
+}
+
+/*
+ * Edge of a column of the capture, played on the simulated keypad
+ */
+static void columnEdge(uint8_t col, uint8_t low, const captureReader_t *r) {
+	column_t	*c = &columns[col];
+	int8_t		row;
+
+	if (low && (!c->inRun || (simNow - c->lastEdge >= RUN_END_MS * SIM_MS))) {
+		if (c->inRun && c->key >= 0) {
+			simSetContact(0, c->key, 0);
+		}
+		row = lookAhead(r, col);
+		c->key = (row >= 0) ? 4 * row + col : -1;
+		c->inRun = 1;
+		c->pressed = 0;
+		c->runStart = simNow;
+		noiseRuns += (row < 0);
+	}
+	c->low = low;
+	c->lastEdge = simNow;
+	if (c->key >= 0) {
+		simSetContact(0, c->key, low);
+	} else {
+		simDrivePin(keypads[0].config->port, keypads[0].config->colPins[col], low ? 0 : SIM_PIN_FREE);
+	}
+}
+
+int main(int argc, char *argv[]) {
+	struct stat		st;
+	const uint8_t	*base;
+	captureIndex_t	*index_;
+	captureReader_t	r;
+	uint64_t		from, to, lo, hi, mid, records = 0;
+	simTime_t		tNs;
+	uint32_t		i, j, k, matches = 0, phantom = 0, boardMatched = 0;
+	uint8_t			last, col, wasScan = 0;
+	int8_t			scan;
+	double			latency, latencySum = 0, latencyMax = 0;
+	clock_t			start;
+	int				fd;
+
+	if (argc < 2) {
+		fprintf(stderr, "usage: capreplay capture.kpe [from_s] [to_s]\n");
+		return 2;
+	}
+	fd = open(argv[1], O_RDONLY);
+	if (fd < 0 || fstat(fd, &st) != 0 || (size_t) st.st_size < sizeof *header) {
+		fprintf(stderr, "capreplay: cannot read %s\n", argv[1]);
+		return 2;
+	}
+	base = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (base == MAP_FAILED) {
+		fprintf(stderr, "capreplay: cannot map %s\n", argv[1]);
+		return 2;
+	}
+	madvise((void *) base, st.st_size, MADV_SEQUENTIAL);
+	header = (captureHeader_t *) base;
+	if (memcmp(header->magic, CAPTURE_MAGIC, 4) || (header->version != CAPTURE_VERSION) || (header->tickNs == 0) ||
+		(header->indexOffset > (uint64_t) st.st_size) || (header->dataOffset > header->indexOffset) ||
+		(header->indexOffset + header->indexEntries * sizeof *index_ > (uint64_t) st.st_size)) {
+		fprintf(stderr, "capreplay: %s is not a capture\n", argv[1]);
+		return 2;
+	}
+	index_ = (captureIndex_t *) (base + header->indexOffset);
+	from = (uint64_t) ((argc > 2 ? atof(argv[2]) : 0) * 1e9 / header->tickNs);
+	to = argc > 3 ? (uint64_t) (atof(argv[3]) * 1e9 / header->tickNs) : header->endTicks;
+
+	/* Seek: the last index entry at or before from */
+	r.p = base + header->dataOffset;
+	r.end = base + header->indexOffset;
+	r.left = header->records;
+	r.ticks = 0;
+	r.levels = header->initialLevels;
+	if (header->indexEntries && index_[0].ticks <= from) {
+		for (lo = 0, hi = header->indexEntries - 1; lo < hi; ) {
+			mid = (lo + hi + 1) / 2;
+			if (index_[mid].ticks <= from) {
+				lo = mid;
+			} else {
+				hi = mid - 1;
+			}
+		}
+		r.p = base + index_[lo].offset;
+		r.left = header->records - index_[lo].record;
+		r.ticks = index_[lo].ticks;
+		r.levels = index_[lo].levels;
+	}
+	while (r.ticks < from && r.left) {
+		captureReader_t	next = r;
+
+		if (!Capture_Next(&next) || next.ticks > from) {
+			break;
+		}
+		r = next;
+	}
+
+	firmwareObserver = observe;
+	Firmware_Start();
+
+	start = clock();
+	last = r.levels | COL_LINES;										// columns low at the start begin their run
+	if (!(r.levels & ROW_LINES)) {
+		for (col = 0; col < 4; col++) {
+			if (!(r.levels & (0x10 << col))) {
+				columnEdge(col, 1, &r);
+			}
+		}
+		last = r.levels;
+	}
+	while (Capture_Next(&r) && r.ticks <= to) {
+		records++;
+		tNs = (r.ticks - from) * header->tickNs;
+		settle(tNs);
+		simAdvance(tNs);
+		scan = scanColumn(r.levels);
+		if (scan >= 0) {
+			if (!wasScan) {
+				col = scan;
+				if (scan == SCAN_ALL) {
+					for (col = 0; col < 4 && !(columns[col].inRun && columns[col].low); col++);
+				}
+				if (col < 4) {
+					addKey(&board, simNow, keypads[0].keyMap[4 * lowRow(r.levels) + col]);
+				}
+			}
+			wasScan = 1;
+			continue;
+		}
+		wasScan = 0;
+		if (r.levels & ROW_LINES) {
+			continue;													// the board switching its pins
+		}
+		for (col = 0; col < 4; col++) {
+			if ((r.levels ^ last) & (0x10 << col)) {
+				columnEdge(col, !(r.levels & (0x10 << col)), &r);
+			}
+		}
+		last = r.levels;
+	}
+	simAdvance(simNow + 100 * SIM_MS);
+	settle(simNow);
+
+	/* Alignment by time: a decoded key matches the last press started before it, if not matched yet */
+	matched = calloc(truth.n + 1, 1);
+	for (i = 0, j = 0; j < decoded.n; j++) {
+		while (i + 1 < truth.n && truth.t[i + 1] <= decoded.t[j]) {
+			i++;
+		}
+		if (truth.n && decoded.t[j] >= truth.t[i] && decoded.t[j] - truth.t[i] <= MATCH_MS * SIM_MS &&
+			decoded.key[j] == truth.key[i] && !matched[i]) {
+			latency = (double) (decoded.t[j] - truth.t[i]) / SIM_MS;
+			latencySum += latency;
+			if (latency > latencyMax) {
+				latencyMax = latency;
+			}
+			matched[i] = 1;
+			matches++;
+		} else {
+			phantom++;
+		}
+	}
+	for (j = 0, k = 0; j < decoded.n; j++) {
+		while (k < board.n && board.t[k] + BOARD_MS * SIM_MS < decoded.t[j]) {
+			k++;
+		}
+		if (k < board.n && board.t[k] <= decoded.t[j] + BOARD_MS * SIM_MS && board.key[k] == decoded.key[j]) {
+			boardMatched++;
+			k++;
+		}
+	}
+
+	printf("{\"capture\": \"%s\", \"from_s\": %.6f, \"to_s\": %.6f, \"records\": %llu, \"presses\": %u, \"decoded\": %u, "
+		   "\"matched\": %u, \"missed\": %u, \"phantom\": %u, \"noise_runs\": %u, \"noise_keys\": %u, "
+		   "\"latency_ms\": {\"avg\": %.2f, \"max\": %.2f}, \"board\": {\"scans\": %u, \"matched\": %u}, "
+		   "\"edges\": %u, \"replayed_s\": %.3f, \"wall_s\": %.3f, \"speed\": %.0f}\n",
+		   argv[1], from * header->tickNs / 1e9, to * header->tickNs / 1e9, (unsigned long long) records, truth.n,
+		   decoded.n, matches, truth.n - matches, phantom, noiseRuns, noiseKeys,
+		   matches ? latencySum / matches : 0.0, latencyMax, board.n, boardMatched, simStats.edges,
+		   (double) simNow / 1e9, (double) (clock() - start) / CLOCKS_PER_SEC,
+		   (double) simNow / 1e9 / ((double) (clock() - start) / CLOCKS_PER_SEC + 1e-9));
+
+	munmap((void *) base, st.st_size);
+	return (phantom || matches < truth.n) ? 1 : 0;
+}
@@ -0,0 +1,85 @@
+/*
+ * capture.h
+ *
+ *  Author: Ahmed Talaat (aa_talaat@yahoo.com)
+ *
+ * Binary edge format of the logic analyzer captures of the keypad port (capconv.c writes it, capreplay.c maps it):
+ *	- A captureHeader_t.
+ *	- The records, one per change of the 8 captured lines: the time since the previous record in ticks of tickNs, as
+ *	  a LEB128 varint, then the level of the lines after the change, one byte (bit 0 = PB8 ... bit 7 = PB15). 2 to 4
+ *	  bytes per change, against 30 to 60 for a line of the CSV export.
+ *	- The seek index, every indexStride records: the time and the levels before that record, and its offset.
+ * Little-endian, as written by the host.
+ */
+
+#ifndef CAPTURE_H_
+#define CAPTURE_H_
+
+#include <stdint.h>
+
+#define CAPTURE_MAGIC			"KPE1"
+#define CAPTURE_VERSION			1
+#define CAPTURE_INDEX_STRIDE	4096
+
+typedef struct captureHeader_s {
+	char		magic[4];
+	uint8_t		version;
+	uint8_t		initialLevels;				// levels of the lines at time 0
+	uint16_t	reserved;
+	uint32_t	tickNs;						// resolution of the timestamps
+	uint32_t	indexStride;
+	uint64_t	records;
+	uint64_t	endTicks;					// time of the last record
+	uint64_t	dataOffset;
+	uint64_t	indexOffset;
+	uint64_t	indexEntries;
+} captureHeader_t;
+
+typedef struct captureIndex_s {
+	uint64_t	ticks;						// time before the record
+	uint64_t	offset;						// of the record, from the start of the file
+	uint64_t	record;						// its number
+	uint8_t		levels;						// levels before the record
+	uint8_t		reserved[7];
+} captureIndex_t;
+
+/*
+ * Reads the records in place from a mapped file
+ */
+typedef struct captureReader_s {
+	const uint8_t	*p, *end;
+	uint64_t		left;						// records still to read
+	uint64_t		ticks;
+	uint8_t			levels;
+} captureReader_t;
+
+/*
+ * Next record: returns 1 with its time and levels in the reader, 0 at the end or on a truncated record
+ */
+static inline uint8_t Capture_Next(captureReader_t *r) {
+	const uint8_t	*p = r->p;
+	uint64_t		delta = 0;
+	uint8_t			shift = 0;
+
+	if (r->left == 0) {
+		return 0;
+	}
+	while (p < r->end && (*p & 0x80)) {
+		if (shift > 56) {
+			return 0;								// not a record
+		}
+		delta |= (uint64_t) (*p++ & 0x7F) << shift;
+		shift += 7;
+	}
+	if (p + 2 > r->end) {						// last byte of the time and the levels
+		return 0;
+	}
+	delta |= (uint64_t) *p++ << shift;
+	r->ticks += delta;
+	r->levels = *p++;
+	r->p = p;
+	r->left--;
+	return 1;
+}
+
+#endif /* CAPTURE_H_ */
@@ -0,0 +1,82 @@
+/*
+ * firmware.c
+ *
+ *  Author: Ahmed Talaat (aa_talaat@yahoo.com)
+ *
+ * main() of main.c on the host, for the simulations (keysim, capreplay, bench and the fleet terminals). The setup,
+ * the handlers of dispatch_table.h and the flows are those of the target (app.c, dispatch.c, uart.c, flow.c...), only
+ * the clocks and the loop itself are modelled here:
+ *	- Firmware_Start() resets the simulator and the state the firmware keeps across runs in the same process, then
+ *	  runs App_Init(), attaches the keypads to the simulated matrices and enters STOP mode, as main() does.
+ *	- Firmware_Loop() is the body of the main loop, called by the simulator after the interrupts (simOnInterrupt). It
+ *	  cannot block: where main() waits in UART_WaitIdle(), it sleeps until the DMA interrupt calls it again.
+ *
+ * firmwareObserver lets a tool see the messages (decoded keys, chatter, faults) before they are dispatched.
+ */
+#include "stm32f10x.h"
+#include "stm32sim.h"
+#include "queues.h"
+#include "buttons.h"
+#include "health.h"
+#include "dispatch.h"
+#include "flow.h"
+#include "tick.h"
+#include "uart.h"
+#include "app.h"
+#include "firmware.h"
+
+firmwareObserver_t	firmwareObserver;
+
+/*
+ * Power-on of the simulated device up to the main loop
+ */
+void Firmware_Start(void) {
+	uint8_t	id;
+
+	simReset();
+	simOnInterrupt = Firmware_Loop;
+	Tick_Release(Tick_Users());					// held at the end of the previous run
+	for (id = 0; id < NUM_KEYPADS; id++) {
+		Health_Reset(id);
+	}
+
+	initializeQueue(&IsrToMainQueue);
+	RCC_APB1PeriphClockCmd(RCC_APB1Periph_PWR, ENABLE);		// HSI_RCC_Configuration
+	App_Init();
+	for (id = 0; id < NUM_KEYPADS; id++) {
+		simAttachMatrix(id, keypads[id].config->port, keypads[id].config->rowPins, keypads[id].config->colPins);
+	}
+	PWR_EnterSTOPMode(PWR_Regulator_LowPower, PWR_STOPEntry_WFI);
+}
+
+/*
+ * The main loop of main(), up to its next sleep
+ */
+void Firmware_Loop(void) {
+	msgQueueDef	msg;
+
+	while (getItemFromQueue(&IsrToMainQueue, &msg) != 0xFF) {
+		if (firmwareObserver) {
+			firmwareObserver(&msg);
+		}
+		dispatchMessage(&msg);
+	}
+	if (Flow_Poll()) {
+		lowPowerRequest = 1;
+	}
+	if (lowPowerRequest) {
+		if (!UART_IsIdle()) {
+			__WFI();								// UART_WaitIdle
+		} else if (App_StopAllowed()) {
+			PWR_EnterSTOPMode(PWR_Regulator_LowPower, PWR_STOPEntry_WFI);
+		} else {
+			__WFI();
+		}
+	} else {
+		__disable_irq();							// key held, sleep until the next message
+		if (isEmpty(&IsrToMainQueue)) {
+			__WFI();
+		}
+		__enable_irq();
+	}
+}
@@ -0,0 +1,19 @@
+/*
+ * firmware.h
+ *
+ *  Author: Ahmed Talaat (aa_talaat@yahoo.com)
+ */
+
+#ifndef FIRMWARE_H_
+#define FIRMWARE_H_
+
+#include "queues.h"
+
+typedef void (*firmwareObserver_t)(msgQueueDef *theMsg);
+
+extern firmwareObserver_t	firmwareObserver;	// sees every message before its handlers, optional
+
+void Firmware_Start(void);
+void Firmware_Loop(void);
+
+#endif /* FIRMWARE_H_ */
@@ -0,0 +1,361 @@
+/*
+ * fleet.c
+ *
+ *  Author: Ahmed Talaat (aa_talaat@yahoo.com)
+ *
+ * Fleet simulator: thousands of terminals, each running the keypad firmware over the peripheral models of stm32sim.c
+ * with its own usage (terminal.c), run on all the cores, with their latency, drop and energy statistics aggregated.
+ * The energy includes the CPU time of the handlers, from the estimated costs of simIrqCycles (see stm32sim.c).
+ *
+ * The firmware keeps its state in globals (the queue, the keypads, the timers), so two terminals cannot run in the
+ * same copy of it at the same time. The firmware and terminal.c are built into a shared library, and every worker
+ * thread loads its own copy: the library file is copied once per worker and each copy opened with dlopen, which maps
+ * its own globals. A worker runs its terminals one after the other in its copy.
+ *
+ * Work stealing: the terminals are split in one range per worker. A worker takes its terminals from the front of
+ * its range and, once empty, steals the back half of the range of another worker. The terminals of the busy classes
+ * take tens of times longer than the others, so the ranges do not end together.
+ *
+ * Terminal classes, the class and the usage of a terminal are drawn from the fleet seed and its index, so a terminal
+ * gives the same result whatever the number of workers:
+ *	- lobby:	a few short sessions an hour, day and night, new keys.
+ *	- office:	sessions through the working day, a few worn keys.
+ *	- kiosk:	busy 16 hours a day, many worn keys and some chatter.
+ *	- factory:	day and night, worn keys and frequent chatter.
+ *
+ * Usage: fleet [terminals] [hours] [seed] [workers] [library] [currents]
+ * The library defaults to keypad_terminal.so next to the fleet executable (keypad_terminal_adaptive.so for the
+ * adaptive debounce), workers to the number of cores. Prints a JSON summary: run it with the library of two firmware
+ * versions to compare them on the same traffic. Returns 2 if the library cannot be loaded.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <dlfcn.h>
+
+#include "stm32f10x.h"
+#include "stm32sim.h"
+#include "terminal.h"
+
+#define MAX_WORKERS		256
+
+typedef struct fleetClass_s {
+	const char	*name;
+	uint8_t		weight;							// share of the fleet, in %
+	double		activeHours;
+	double		sessionsPerHour;
+	uint8_t		keysPerSession;
+	uint8_t		wornPercent;
+	uint8_t		chatterPercent;
+} fleetClass_t;
+
+typedef struct worker_s {
+	pthread_t		thread;
+	pthread_mutex_t	lock;						// protects next and end
+	uint32_t		next, end;					// range of terminals still to run
+	terminalRun_t	run;
+	void			*library;
+	uint32_t		terminals;					// terminals run
+	uint32_t		steals;
+	double			cpuS;						// CPU time of the thread in the terminals
+} worker_t;
+
+static const fleetClass_t	classes[] = {
+	{"lobby",	30, 24, 3,	4, 0,	0},
+	{"office",	40, 10, 20,	5, 10,	0},
+	{"kiosk",	20, 16, 60,	6, 30,	2},
+	{"factory",	10, 24, 25,	4, 50,	10},
+};
+#define NUM_CLASSES		(sizeof classes / sizeof classes[0])
+
+static worker_t				workers[MAX_WORKERS];
+static uint32_t				nWorkers;
+static terminalProfile_t	*profiles;
+static terminalResult_t		*results;
+static uint8_t				*terminalClass;
+
+static double clockS(clockid_t clock) {
+	struct timespec	ts;
+
+	clock_gettime(clock, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/*
+ * splitmix64: the random numbers of a terminal from the fleet seed and its index
+ */
+static uint64_t mix(uint64_t x) {
+	x += 0x9E3779B97F4A7C15ULL;
+	x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+	x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+	return x ^ (x >> 31);
+}
+
+static double unit(uint64_t x) {
+	return (double) (mix(x) >> 11) / 9007199254740992.0;
+}
+
+static void buildProfiles(uint32_t terminals, double hours, uint64_t seed) {
+	uint64_t	base;
+	uint32_t	i, pick;
+	uint8_t		c;
+
+	for (i = 0; i < terminals; i++) {
+		base = mix(seed ^ ((uint64_t) i << 20));
+		pick = (uint32_t) (unit(base) * 100);
+		for (c = 0; c < NUM_CLASSES - 1 && pick >= classes[c].weight; c++) {
+			pick -= classes[c].weight;
+		}
+		terminalClass[i] = c;
+		profiles[i].seed = mix(base + 1);
+		profiles[i].hours = hours;
+		profiles[i].activeHours = classes[c].activeHours;
+		profiles[i].sessionsPerHour = classes[c].sessionsPerHour * (0.5 + unit(base + 2));
+		profiles[i].keysPerSession = classes[c].keysPerSession;
+		profiles[i].wornPercent = classes[c].wornPercent;
+		profiles[i].chatterPercent = classes[c].chatterPercent;
+	}
+}
+
+/*
+ * Own copy of the firmware library for a worker. Returns 0, or -1 with the error printed.
+ */
+static int loadLibrary(worker_t *w, const char *path, const char *dir, uint32_t index, const char *currents) {
+	char	copy[4096], buffer[65536];
+	FILE	*in, *out;
+	size_t	n;
+	int		(*loadCurrents)(const char *);
+
+	snprintf(copy, sizeof copy, "%s/terminal-%u.so", dir, index);
+	in = fopen(path, "rb");
+	out = fopen(copy, "wb");
+	if (in == NULL || out == NULL) {
+		fprintf(stderr, "fleet: cannot copy %s to %s\n", path, copy);
+		if (in) fclose(in);
+		if (out) fclose(out);
+		return -1;
+	}
+	while ((n = fread(buffer, 1, sizeof buffer, in)) > 0) {
+		fwrite(buffer, 1, n, out);
+	}
+	fclose(in);
+	fclose(out);
+
+	w->library = dlopen(copy, RTLD_NOW | RTLD_LOCAL);
+	unlink(copy);
+	if (w->library == NULL) {
+		fprintf(stderr, "fleet: %s\n", dlerror());
+		return -1;
+	}
+	*(void **) &w->run = dlsym(w->library, "Terminal_Run");
+	*(void **) &loadCurrents = dlsym(w->library, "simLoadCurrents");
+	if (w->run == NULL || loadCurrents == NULL) {
+		fprintf(stderr, "fleet: %s is not a terminal library\n", path);
+		return -1;
+	}
+	if (currents && loadCurrents(currents) != 0) {
+		fprintf(stderr, "fleet: cannot read the current table %s\n", currents);
+		return -1;
+	}
+	return 0;
+}
+
+/*
+ * Next terminal for a worker: the front of its own range, or the back half of the range of another worker.
+ * Returns -1 once every range is empty (no terminal adds work, so one empty pass is final).
+ */
+static int64_t takeTerminal(uint32_t self) {
+	worker_t	*w = &workers[self], *victim;
+	uint32_t	k, half, mid;
+	int64_t		terminal = -1;
+
+	pthread_mutex_lock(&w->lock);
+	if (w->next < w->end) {
+		terminal = w->next++;
+	}
+	pthread_mutex_unlock(&w->lock);
+	if (terminal >= 0) {
+		return terminal;
+	}
+
+	for (k = 1; k < nWorkers; k++) {
+		victim = &workers[(self + k) % nWorkers];
+		pthread_mutex_lock(&victim->lock);
+		half = (victim->end - victim->next + 1) / 2;
+		mid = victim->end - half;
+		if (half > 0) {
+			victim->end = mid;
+		}
+		pthread_mutex_unlock(&victim->lock);
+		if (half > 0) {
+			pthread_mutex_lock(&w->lock);
+			w->next = mid + 1;
+			w->end = mid + half;
+			pthread_mutex_unlock(&w->lock);
+			w->steals++;
+			return mid;
+		}
+	}
+	return -1;
+}
+
+static void *workerThread(void *arg) {
+	uint32_t	self = (uint32_t) (uintptr_t) arg;
+	worker_t	*w = &workers[self];
+	int64_t		terminal;
+	double		start;
+
+	while ((terminal = takeTerminal(self)) >= 0) {
+		start = clockS(CLOCK_THREAD_CPUTIME_ID);
+		w->run(&profiles[terminal], &results[terminal]);
+		w->cpuS += clockS(CLOCK_THREAD_CPUTIME_ID) - start;
+		w->terminals++;
+	}
+	return NULL;
+}
+
+/*
+ * Latency in whole ms (the TIM4 resolution) under which the given share of the decoded presses falls
+ */
+static double percentile(const uint64_t hist[TERMINAL_LATENCY_BINS], uint64_t total, double share) {
+	uint64_t	count = 0;
+	uint8_t		bin;
+
+	for (bin = 0; bin < TERMINAL_LATENCY_BINS; bin++) {
+		count += hist[bin];
+		if (total && count >= share * total) {
+			return bin;
+		}
+	}
+	return TERMINAL_LATENCY_BINS - 1;
+}
+
+int main(int argc, char *argv[]) {
+	uint32_t			terminals = argc > 1 ? strtoul(argv[1], NULL, 0) : 1000;
+	double				hours = argc > 2 ? atof(argv[2]) : 24;
+	uint64_t			seed = argc > 3 ? strtoull(argv[3], NULL, 0) : 1;
+	long				cores = sysconf(_SC_NPROCESSORS_ONLN);
+	const char			*currents = argc > 6 ? argv[6] : NULL;
+	char				library[4096], dir[] = "/tmp/fleetXXXXXX";
+	const char			*slash;
+	uint64_t			hist[TERMINAL_LATENCY_BINS] = {0}, decoded = 0, presses = 0, missed = 0, phantom = 0;
+	uint64_t			chatter = 0, faults = 0, stops = 0, irqs = 0, steals = 0;
+	uint64_t			classCount[NUM_CLASSES] = {0}, classPresses[NUM_CLASSES] = {0}, classMissed[NUM_CLASSES] = {0};
+	uint64_t			classPhantom[NUM_CLASSES] = {0}, classDecoded[NUM_CLASSES] = {0};
+	double				classUa[NUM_CLASSES] = {0}, classLatency[NUM_CLASSES] = {0}, latencySum = 0, uaSum = 0, uaMax = 0, latencyMax = 0, cpu = 0, wall, start;
+	uint32_t			i, b, per;
+	simCurrents_t		*tableOfCopy;
+
+	nWorkers = argc > 4 ? strtoul(argv[4], NULL, 0) : (cores > 0 ? (uint32_t) cores : 1);
+	if (nWorkers == 0 || nWorkers > MAX_WORKERS) {
+		nWorkers = nWorkers ? MAX_WORKERS : 1;
+	}
+	if (argc > 5) {
+		snprintf(library, sizeof library, "%s", argv[5]);
+	} else {
+		slash = strrchr(argv[0], '/');
+		snprintf(library, sizeof library, "%.*s%skeypad_terminal.so", slash ? (int) (slash - argv[0]) : 0, argv[0],
+				 slash ? "/" : "./");
+	}
+	if (terminals == 0 || mkdtemp(dir) == NULL) {
+		fprintf(stderr, "fleet: nothing to run\n");
+		return 2;
+	}
+
+	for (i = 0; i < nWorkers; i++) {
+		if (loadLibrary(&workers[i], library, dir, i, currents) != 0) {
+			rmdir(dir);
+			return 2;
+		}
+	}
+	rmdir(dir);
+
+	profiles = calloc(terminals, sizeof *profiles);
+	results = calloc(terminals, sizeof *results);
+	terminalClass = calloc(terminals, 1);
+	buildProfiles(terminals, hours, seed);
+
+	per = (terminals + nWorkers - 1) / nWorkers;
+	for (i = 0; i < nWorkers; i++) {
+		pthread_mutex_init(&workers[i].lock, NULL);
+		workers[i].next = (i * per < terminals) ? i * per : terminals;
+		workers[i].end = ((i + 1) * per < terminals) ? (i + 1) * per : terminals;
+	}
+	start = clockS(CLOCK_MONOTONIC);
+	for (i = 0; i < nWorkers; i++) {
+		pthread_create(&workers[i].thread, NULL, workerThread, (void *) (uintptr_t) i);
+	}
+	for (i = 0; i < nWorkers; i++) {
+		pthread_join(workers[i].thread, NULL);
+		cpu += workers[i].cpuS;
+		steals += workers[i].steals;
+	}
+	wall = clockS(CLOCK_MONOTONIC) - start;
+
+	/* In terminal order, so the sums do not depend on the workers */
+	for (i = 0; i < terminals; i++) {
+		presses += results[i].presses;
+		decoded += results[i].decoded;
+		missed += results[i].missed;
+		phantom += results[i].phantom;
+		chatter += results[i].chatterEvents;
+		faults += results[i].faultEvents;
+		stops += results[i].stopEntries;
+		irqs += results[i].irqs;
+		for (b = 0; b < TERMINAL_LATENCY_BINS; b++) {
+			hist[b] += results[i].latency[b];
+		}
+		latencySum += results[i].latencySumMs;
+		if (results[i].latencyMaxMs > latencyMax) {
+			latencyMax = results[i].latencyMaxMs;
+		}
+		uaSum += results[i].averageUa;
+		if (results[i].averageUa > uaMax) {
+			uaMax = results[i].averageUa;
+		}
+		classCount[terminalClass[i]]++;
+		classPresses[terminalClass[i]] += results[i].presses;
+		classMissed[terminalClass[i]] += results[i].missed;
+		classPhantom[terminalClass[i]] += results[i].phantom;
+		classDecoded[terminalClass[i]] += results[i].decoded;
+		classLatency[terminalClass[i]] += results[i].latencySumMs;
+		classUa[terminalClass[i]] += results[i].averageUa;
+	}
+	*(void **) &tableOfCopy = dlsym(workers[0].library, "simCurrents");
+
+	printf("{\"terminals\": %u, \"hours\": %.2f, \"seed\": %llu, \"workers\": %u, \"classes\": {", terminals, hours,
+		   (unsigned long long) seed, nWorkers);
+	for (i = 0; i < NUM_CLASSES; i++) {
+		printf("%s\"%s\": {\"terminals\": %llu, \"presses\": %llu, \"missed\": %llu, \"phantom\": %llu, \"latency_avg_ms\": %.2f, "
+			   "\"avg_ua\": %.1f}",
+			   i ? ", " : "", classes[i].name, (unsigned long long) classCount[i], (unsigned long long) classPresses[i],
+			   (unsigned long long) classMissed[i], (unsigned long long) classPhantom[i],
+			   classDecoded[i] ? classLatency[i] / classDecoded[i] : 0.0,
+			   classCount[i] ? classUa[i] / classCount[i] : 0.0);
+	}
+	printf("}, \"presses\": %llu, \"decoded\": %llu, \"missed\": %llu, \"phantom\": %llu, \"drop_rate\": %.6f, "
+		   "\"latency_ms\": {\"avg\": %.2f, \"p50\": %.0f, \"p99\": %.0f, \"p999\": %.0f, \"max\": %.2f}, "
+		   "\"chatter_events\": %llu, \"fault_events\": %llu, "
+		   "\"energy\": {\"avg_ua\": %.1f, \"max_ua\": %.1f, \"min_battery_days\": %.1f, \"stop_entries\": %llu}, "
+		   "\"irqs\": %llu, \"wall_s\": %.3f, \"cpu_s\": %.3f, \"parallelism\": %.2f, \"steals\": %llu, "
+		   "\"terminal_hours_per_s\": %.0f}\n",
+		   (unsigned long long) presses, (unsigned long long) decoded, (unsigned long long) missed,
+		   (unsigned long long) phantom, presses ? (double) missed / presses : 0.0,
+		   decoded ? latencySum / decoded : 0.0, percentile(hist, decoded, 0.5), percentile(hist, decoded, 0.99),
+		   percentile(hist, decoded, 0.999), latencyMax,
+		   (unsigned long long) chatter, (unsigned long long) faults,
+		   uaSum / terminals, uaMax, uaMax > 0 ? tableOfCopy->batteryMah * 1000.0 / uaMax / 24.0 : 0.0,
+		   (unsigned long long) stops, (unsigned long long) irqs, wall, cpu, wall > 0 ? cpu / wall : 0.0,
+		   (unsigned long long) steals, wall > 0 ? terminals * hours / wall : 0.0);
+
+	for (i = 0; i < nWorkers; i++) {
+		dlclose(workers[i].library);
+	}
+	free(profiles);
+	free(results);
+	free(terminalClass);
+	return 0;
+}
@@ -0,0 +1,124 @@
+/*
+ * keymaptest.c
+ *
+ *  Author: Ahmed Talaat (aa_talaat@yahoo.com)
+ *
+ * Host test of the FN layer of keymap.c: FN is held on the simulated matrix, then the keys of the FN layer are pressed
+ * with it, and the keys go through the firmware of firmware.c, from the EXTI edge to Keymap_OnKeyDown and the flows.
+ * The keys are looked up in defaultLayers, so a layer key put where the matrix cannot see it while FN is held fails.
+ * FN+1 and FN+2 must toggle the HEX and CALC layers, FN+3 must send D, and the layers must show on the keys pressed
+ * once FN is released. A second layout has the same KM_MO key in two columns: the layer must be released with the
+ * column of the key held. The contacts do not bounce, the debounce is checked by keysim.
+ *
+ * Usage: keymaptest
+ * Prints one line per step and returns 0 when they all pass.
+ *
+ * Build:		make tools, against build/libkeypad_host.a. make check runs it.
+ */
+#include <stdio.h>
+
+#include "stm32f10x.h"
+#include "stm32sim.h"
+#include "queues.h"
+#include "keymap.h"
+#include "firmware.h"
+
+#define HOLD_MS			80
+#define GAP_MS			150
+
+/* Same KM_MO key at the start of the bottom row and at its end */
+static const uint8_t	twinLayers[2][16] = {
+	{	'1', '2', '3', 'A',
+		'4', '5', '6', 'B',
+		'7', '8', '9', 'C',
+		KM_MO(1), '0', '#', KM_MO(1)	},
+
+	{	'a', 'b', 'c', 'd',
+		KM_TRANS, KM_TRANS, KM_TRANS, KM_TRANS,
+		KM_TRANS, KM_TRANS, KM_TRANS, KM_TRANS,
+		KM_TRANS, KM_TRANS, KM_TRANS, KM_TRANS	}
+};
+
+static uint8_t	lastKey;					// content of the last MSG_BT_DOWN
+static uint8_t	failures;
+
+static void observe(msgQueueDef *msg) {
+	if (msg->msgID == MSG_BT_DOWN) {
+		lastKey = msg->msgContent;
+	}
+}
+
+/*
+ * Matrix index of a code in a default layer, 16 if it is not there
+ */
+static uint8_t findKey(uint8_t layer, uint8_t code) {
+	uint8_t	key;
+
+	for (key = 0; key < 16 && defaultLayers[layer][key] != code; key++) {
+	}
+	return key;
+}
+
+static void contact(uint8_t key, uint8_t closed, uint32_t ms) {
+	simSetContact(0, key, closed);
+	simAdvance(simNow + ms * SIM_MS);
+}
+
+/*
+ * Press and release one key, with FN held or not. Returns the key decoded for it, 0 if none.
+ */
+static uint8_t press(uint8_t key) {
+	lastKey = 0;
+	contact(key, 1, HOLD_MS);
+	contact(key, 0, GAP_MS);
+	return lastKey;
+}
+
+static void check(const char *step, uint8_t pass) {
+	printf("%s: %s\n", step, pass ? "pass" : "FAIL");
+	if (!pass) {
+		failures++;
+	}
+}
+
+int main(void) {
+	keymap_t	*keymap = &keymaps[0];
+	uint8_t		fn = findKey(LAYER_BASE, KM_MO(LAYER_FN));
+	uint8_t		hex = findKey(LAYER_FN, KM_TG(LAYER_HEX)), calc = findKey(LAYER_FN, KM_TG(LAYER_CALC));
+	uint8_t		d = findKey(LAYER_FN, 'D'), star = findKey(LAYER_BASE, '*'), one = findKey(LAYER_BASE, '1');
+
+	firmwareObserver = observe;
+	Firmware_Start();
+	if (fn == 16 || hex == 16 || calc == 16 || d == 16) {
+		printf("FN layer keys not found in defaultLayers\n");
+		return 1;
+	}
+
+	lastKey = 0;
+	contact(fn, 1, GAP_MS);
+	check("FN down consumed by the keymap", lastKey == KM_MO(LAYER_FN) && (keymap->momentary & (1 << LAYER_FN)));
+	press(hex);
+	check("FN+1 toggles HEX", keymap->toggled == (1 << LAYER_HEX));
+	press(calc);
+	check("FN+2 toggles CALC", keymap->toggled == ((1 << LAYER_HEX) | (1 << LAYER_CALC)));
+	check("FN+3 sends D", press(d) == 'D');
+	contact(fn, 0, GAP_MS);
+	check("FN up releases the layer", keymap->momentary == 0);
+
+	check("* is E in HEX", press(star) == 'E');
+	check("1 is 7 in CALC", press(one) == '7');
+
+	contact(fn, 1, GAP_MS);
+	press(hex);
+	press(calc);
+	contact(fn, 0, GAP_MS);
+	check("FN+1 and FN+2 again restore the base layer", keymap->toggled == 0 && press(star) == '*' && press(one) == '1');
+
+	Keymap_SelectLayers(keymap, twinLayers, 2);
+	contact(15, 1, GAP_MS);
+	check("Second KM_MO key holds the layer", keymap->momentary == (1 << 1) && press(1) == 'b');
+	contact(15, 0, GAP_MS);
+	check("Second KM_MO key up releases the layer", keymap->momentary == 0 && press(1) == '2');
+
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,360 @@
+/*
+ * keysim.c
+ *
+ *  Author: Ahmed Talaat (aa_talaat@yahoo.com)
+ *
+ * Host simulation of the matrix keypad firmware: the ISRs, the main loop handlers and the flows run unchanged against
+ * the peripheral models of stm32sim.c, with main() modelled by firmware.c. A keypad is wired on the pins of
+ * keypadConfigs[0], and a sequence of key presses with contact bounce is played on it. The decoded keys are compared
+ * with the pressed ones, in the keymap layers active when they are decoded (the application flows may switch them).
+ *
+ * The energy is accounted by stm32sim.c with its current table, or with the one of the currents file (see
+ * simLoadCurrents): time in run, sleep and STOP, average current, charge per press and battery life for the workload.
+ * The CPU time of the handlers, hence cpu_share and cpu_share_max, comes from the estimated costs of simIrqCycles: it
+ * scales with them. The energy hardly does, the handlers are a small part of the run time (doubling every cost adds
+ * under 1 % to avg_ua on the mixed, noise and pin workloads).
+ * The gap between the presses is 60 to 400 ms, or 0.5 to 1.5 times gap_ms when given.
+ *
+ * Bounce workloads, the contact toggles at random for the bounce time at each press and release, never staying quiet
+ * more than BOUNCE_GAP_MS while it bounces:
+ *	- new:		every key bounces for 1.5 to 3 ms.
+ *	- worn:		every key bounces for 8 to 15 ms.
+ *	- mixed:	one key per column is worn (10 to 15 ms), the other ones are new.
+ *	- chatter:	mixed, and 1 hold out of 10 has bursts of contact loss of up to 3 ms.
+ *	- noise:	mixed on the first 3 columns, while the wire of the 4th one gets bursts of noise (0.2 to 2 s every 3 to
+ *				10 s, at 200 Hz to 100 kHz). Checks the storm protection (storm.c): cpu_share_max is the worst share of
+ *				the CPU taken by the keypad interrupts over NOISE_WINDOW_MS, and the keys of the other columns must
+ *				still be decoded. The noise keys (no row found) are counted apart.
+ *	- pin:		mixed, typed as 4-digit codes, 3 out of 4 being the password of pinFlow (app.c): 0.4 to 1.5 s between
+ *				the digits of a code, 10 to 30 s between the codes. Checks the energy of the flows waiting with a
+ *				timeout between the digits.
+ *
+ * Usage: keysim [workload] [presses] [seed] [gap_ms] [currents]
+ * Prints a JSON summary and returns 0 when every key was decoded once with no phantom or missed key.
+ *
+ * Build:		make tools, against build/libkeypad_host.a (HOST_SRC of the Makefile)
+ * Adaptive:	same with -DKEYPAD_ADAPTIVE_DEBOUNCE, against build/libkeypad_host_adaptive.a: build/keysim_adaptive
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "stm32f10x.h"
+#include "stm32sim.h"
+#include "queues.h"
+#include "buttons.h"
+#include "keymap.h"
+#include "storm.h"
+#include "firmware.h"
+
+#define MAX_PRESSES		100000
+#define BOUNCE_GAP_MS	1.5
+#define NOISE_WINDOW_MS	100
+
+typedef struct contactEvent_s {
+	simTime_t	t;
+	uint8_t		key;
+	uint8_t		closed;
+} contactEvent_t;
+
+typedef struct eventList_s {
+	contactEvent_t	*events;
+	uint32_t		nEvents, maxEvents;
+} eventList_t;
+
+typedef struct keyRun_s {
+	eventList_t		contacts;				// key contacts
+	eventList_t		noise;					// noise on the 4th column wire: key is unused, closed is the level
+	uint32_t		noiseEdges;
+	uint8_t			expected[MAX_PRESSES];	// matrix index of the key pressed
+	simTime_t		pressStart[MAX_PRESSES];
+	uint32_t		nExpected;
+	uint32_t		current;				// last press started
+	uint32_t		nDecoded;
+	uint32_t		matched, phantom;
+	double			latencySum, latencyMax;
+	uint32_t		ups;
+	uint32_t		chatterEvents;
+	uint32_t		faultEvents;
+	uint32_t		noiseKeys;
+} keyRun_t;
+
+static keyRun_t	run;
+static uint8_t	matchedPress[MAX_PRESSES];
+static double	gapMs;
+
+static double uniform(double lo, double hi) {
+	return lo + (hi - lo) * rand() / (double) RAND_MAX;
+}
+
+static void addEventTo(eventList_t *list, simTime_t t, uint8_t key, uint8_t closed) {
+	if (list->nEvents == list->maxEvents) {
+		list->maxEvents = list->maxEvents ? 2 * list->maxEvents : 4096;
+		list->events = realloc(list->events, list->maxEvents * sizeof *list->events);
+	}
+	list->events[list->nEvents].t = t;
+	list->events[list->nEvents].key = key;
+	list->events[list->nEvents].closed = closed;
+	list->nEvents++;
+}
+
+static void addEvent(simTime_t t, uint8_t key, uint8_t closed) {
+	addEventTo(&run.contacts, t, key, closed);
+}
+
+/*
+ * Contact toggling from t0 for bounceMs, ending in the given state. Returns the date of the last edge.
+ */
+static simTime_t bounce(simTime_t t0, double bounceMs, uint8_t key, uint8_t closed) {
+	simTime_t	end = t0 + (simTime_t) (bounceMs * SIM_MS), t = t0;
+	uint8_t		state = closed;
+
+	addEvent(t, key, state);
+	while (1) {
+		t += (simTime_t) (uniform(0.05, BOUNCE_GAP_MS) * SIM_MS);
+		if (t >= end) {
+			break;
+		}
+		state = !state;
+		addEvent(t, key, state);
+	}
+	if (state != closed) {
+		addEvent(end, key, closed);
+		t = end;
+	} else {
+		t = run.contacts.events[run.contacts.nEvents - 1].t;
+	}
+	return t;
+}
+
+/*
+ * Bounce time of a key for the workload
+ */
+static double bounceTime(const char *workload, uint8_t key) {
+	uint8_t	worn = (key / 4) == (key % 4);					// the diagonal: one key per column
+
+	if (!strcmp(workload, "worn") || (worn && strcmp(workload, "new"))) {
+		return !strcmp(workload, "worn") ? uniform(8, 15) : uniform(10, 15);
+	}
+	return uniform(1.5, 3);
+}
+
+/*
+ * Bursts of noise on the 4th column wire up to the end date: the wire toggles at random around the burst rate, then
+ * is released
+ */
+static void buildNoise(simTime_t end) {
+	static const double	rates[] = {200, 2000, 20000, 100000};		// edges per second
+	simTime_t	t = 1000 * SIM_MS, burstEnd;
+	double		rate;
+	uint8_t		level;
+
+	while (t < end) {
+		burstEnd = t + (simTime_t) (uniform(200, 2000) * SIM_MS);
+		rate = rates[rand() % 4];
+		level = 0;
+		while (t < burstEnd) {
+			addEventTo(&run.noise, t, 0, level);
+			run.noiseEdges++;
+			level = !level;
+			t += (simTime_t) (uniform(0.2, 1.8) * 1e9 / rate) + 1;
+		}
+		addEventTo(&run.noise, burstEnd, 0, 2);
+		t = burstEnd + (simTime_t) (uniform(3000, 10000) * SIM_MS);
+	}
+}
+
+static void buildWorkload(const char *workload, uint32_t presses) {
+	static const uint8_t	digitKeys[10] = {0, 1, 2, 4, 5, 6, 8, 9, 10, 13};	// matrix index of 1 to 9, then 0
+	simTime_t	t = 50 * SIM_MS, holdEnd, glitch;
+	uint32_t	i;
+	uint8_t		key, pin = !strcmp(workload, "pin"), password = 0;
+	double		gap;
+
+	for (i = 0; i < presses; i++) {
+		if (pin && (i % 4 == 0)) {
+			password = (rand() % 4 != 0);
+		}
+		if (pin) {
+			key = password ? digitKeys[i % 4 == 3 ? 3 : i % 4] : digitKeys[rand() % 10];	// 1 2 3 4
+		} else {
+			key = rand() % 16;
+		}
+		if (!strcmp(workload, "noise") && (key % 4 == 3)) {
+			key--;												// the 4th column only gets the noise
+		}
+		run.expected[i] = key;
+		run.pressStart[i] = t;
+		t = bounce(t, bounceTime(workload, key), key, 1);
+		holdEnd = t + (simTime_t) (uniform(60, 250) * SIM_MS);
+		if (!strcmp(workload, "chatter") && (rand() % 10 == 0)) {
+			for (glitch = t + 20 * SIM_MS; glitch + 10 * SIM_MS < holdEnd; glitch += (simTime_t) (uniform(15, 40) * SIM_MS)) {
+				glitch = bounce(glitch, uniform(0.3, 3), key, 0);
+				bounce(glitch + (simTime_t) (uniform(0.2, 0.6) * SIM_MS), uniform(0.3, 1.5), key, 1);
+			}
+		}
+		t = bounce(holdEnd, bounceTime(workload, key), key, 0);
+		if (gapMs > 0) {
+			gap = uniform(0.5 * gapMs, 1.5 * gapMs);
+		} else if (pin) {
+			gap = (i % 4 == 3) ? uniform(10000, 30000) : uniform(400, 1500);
+		} else {
+			gap = uniform(60, 400);
+		}
+		t += (simTime_t) (gap * SIM_MS);
+	}
+	run.nExpected = presses;
+	if (!strcmp(workload, "noise")) {
+		buildNoise(t);
+	}
+}
+
+/*
+ * Messages of the firmware main loop. A decoded key matches the last press started before it, if not matched yet and
+ * with the code of that key in the active layers. Otherwise it is a phantom.
+ */
+static void observe(msgQueueDef *msg) {
+	uint32_t	i;
+	double		latency;
+
+	switch (msg->msgID) {
+		case MSG_BT_DOWN:
+			if (msg->msgContent == 0) {
+				run.noiseKeys++;							// no row found: a column edge without a key
+				break;
+			}
+			run.nDecoded++;
+			while (run.current + 1 < run.nExpected && run.pressStart[run.current + 1] <= simNow) {
+				run.current++;
+			}
+			i = run.current;
+			if (simNow >= run.pressStart[i] && msg->msgContent == keymaps[0].keyMap[run.expected[i]] && !matchedPress[i]) {
+				latency = (double) (simNow - run.pressStart[i]) / SIM_MS;
+				run.latencySum += latency;
+				if (latency > run.latencyMax) {
+					run.latencyMax = latency;
+				}
+				matchedPress[i] = 1;
+				run.matched++;
+			} else {
+				run.phantom++;
+			}
+			break;
+		case MSG_BT_UP:
+			run.ups++;
+			break;
+		case MSG_KEY_CHATTER:
+			run.chatterEvents++;
+			break;
+		case MSG_LINE_FAULT:
+			run.faultEvents++;
+			break;
+		default:
+			break;
+	}
+}
+
+static simTime_t	windowStart, windowCpuNs;
+static double		cpuShareMax;
+
+static simTime_t keypadCpuNs(void) {
+	simTime_t	ns = 0;
+	uint8_t		i;
+
+	for (i = 0; i < SIM_IRQ_COUNT; i++) {
+		ns += simStats.irqNs[i];
+	}
+	return ns;
+}
+
+/*
+ * simAdvance, keeping the worst CPU share over the NOISE_WINDOW_MS windows
+ */
+static void advanceTo(simTime_t t) {
+	simTime_t	ns;
+
+	while (windowStart + NOISE_WINDOW_MS * SIM_MS <= t) {
+		simAdvance(windowStart + NOISE_WINDOW_MS * SIM_MS);
+		ns = keypadCpuNs();
+		if ((double) (ns - windowCpuNs) / (NOISE_WINDOW_MS * SIM_MS) > cpuShareMax) {
+			cpuShareMax = (double) (ns - windowCpuNs) / (NOISE_WINDOW_MS * SIM_MS);
+		}
+		windowCpuNs = ns;
+		windowStart += NOISE_WINDOW_MS * SIM_MS;
+	}
+	simAdvance(t);
+}
+
+int main(int argc, char *argv[]) {
+	const char	*workload = argc > 1 ? argv[1] : "mixed";
+	uint32_t	presses = argc > 2 ? (uint32_t) atoi(argv[2]) : 2000;
+	unsigned	seed = argc > 3 ? (unsigned) atoi(argv[3]) : 1;
+	double		ua;
+	uint32_t	i, n, missed, faults = 0;
+	contactEvent_t	*e;
+	clock_t		start;
+	uint8_t		adaptive = 0;
+
+#ifdef KEYPAD_ADAPTIVE_DEBOUNCE
+	adaptive = 1;
+#endif
+	if (presses > MAX_PRESSES) {
+		presses = MAX_PRESSES;
+	}
+	gapMs = argc > 4 ? atof(argv[4]) : 0;
+	if (argc > 5 && simLoadCurrents(argv[5]) != 0) {
+		fprintf(stderr, "keysim: cannot read the current table %s\n", argv[5]);
+		return 2;
+	}
+	srand(seed);
+
+	firmwareObserver = observe;
+	Firmware_Start();
+
+	buildWorkload(workload, presses);
+
+	start = clock();
+	for (i = 0, n = 0; i < run.contacts.nEvents || n < run.noise.nEvents; ) {
+		if (n == run.noise.nEvents || (i < run.contacts.nEvents && run.contacts.events[i].t <= run.noise.events[n].t)) {
+			e = &run.contacts.events[i++];
+			advanceTo(e->t);
+			simSetContact(0, e->key, e->closed);
+		} else {
+			e = &run.noise.events[n++];
+			advanceTo(e->t);
+			simDrivePin(keypads[0].config->port, keypads[0].config->colPins[3], e->closed == 2 ? SIM_PIN_FREE : e->closed);
+		}
+	}
+	advanceTo(simNow + 100 * SIM_MS);
+
+	missed = run.nExpected - run.matched;
+	for (i = 0; i < 16; i++) {
+		faults += lineGuards[i].faults;
+	}
+	ua = simAverageUa();
+
+	printf("{\"workload\": \"%s\", \"adaptive\": %u, \"presses\": %u, \"decoded\": %u, \"phantom\": %u, \"missed\": %u, "
+		   "\"ups\": %u, \"latency_ms\": {\"avg\": %.2f, \"max\": %.2f}, \"debounce_ms\": [%u, %u, %u, %u], "
+		   "\"chatter_events\": %u, \"edges\": %u, \"irqs\": {\"exti\": %u, \"tim4\": %u, \"pendsv\": %u, \"systick\": %u, \"rtc_alarm\": %u}, "
+		   "\"cpu_share\": %.6f, \"cpu_share_max\": %.4f, "
+		   "\"storm\": {\"noise_edges\": %u, \"noise_keys\": %u, \"quarantines\": %u, \"fault_events\": %u}, "
+		   "\"energy\": {\"run_s\": %.2f, \"sleep_s\": %.2f, \"stop_s\": %.2f, \"stop_entries\": %u, "
+		   "\"avg_ua\": %.1f, \"peripheral_ua\": %.1f, \"uc_per_press\": %.1f, \"battery_days\": %.1f}, "
+		   "\"simulated_s\": %.1f, \"wall_s\": %.3f}\n",
+		   workload, adaptive, presses, run.nDecoded, run.phantom, missed, run.ups,
+		   run.matched ? run.latencySum / run.matched : 0.0, run.latencyMax,
+		   keypads[0].debounceMs[0], keypads[0].debounceMs[1], keypads[0].debounceMs[2], keypads[0].debounceMs[3],
+		   run.chatterEvents, simStats.edges,
+		   simStats.irqCount[SIM_IRQ_EXTI9_5] + simStats.irqCount[SIM_IRQ_EXTI15_10], simStats.irqCount[SIM_IRQ_TIM4],
+		   simStats.irqCount[SIM_IRQ_PENDSV], simStats.irqCount[SIM_IRQ_SYSTICK],
+		   simStats.irqCount[SIM_IRQ_RTC_ALARM], (double) keypadCpuNs() / (double) simNow, cpuShareMax,
+		   run.noiseEdges, run.noiseKeys, faults, run.faultEvents,
+		   (double) simEnergy.stateNs[SIM_RUN] / 1e9, (double) simEnergy.stateNs[SIM_SLEEP] / 1e9,
+		   (double) simEnergy.stateNs[SIM_STOP] / 1e9, simEnergy.stopEntries, ua,
+		   simEnergy.peripheralUc / ((double) simNow / 1e9), (simEnergy.coreUc + simEnergy.peripheralUc) / presses,
+		   simBatteryDays(), (double) simNow / 1e9,
+		   (double) (clock() - start) / CLOCKS_PER_SEC);
+
+	return (run.phantom || missed) ? 1 : 0;
+}
@@ -0,0 +1,282 @@
+/*
+ * kpmon.c
+ *
+ *  Author: Ahmed Talaat (aa_talaat@yahoo.com)
+ *
+ * Host side monitor of the keypad event stream sent by the firmware over the UART (see frame.h).
+ *
+ * Usage:
+ *	kpmon <tty> [baudrate]		Decode the frames received on a serial port and print the events, with the event rate,
+ *								the CRC errors and the lost frames once per second.
+ *	kpmon --loopback [events]	Self test through a pseudo-terminal: a writer thread encodes events with the same framing
+ *								as the firmware into the pty master, always in full frames, while the decoder reads the
+ *								slave. Reports the end-to-end events/sec and the latency from the frame creation to its
+ *								decoding.
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <termios.h>
+#include <pthread.h>
+#include <poll.h>
+#include <sched.h>
+#include <time.h>
+
+#include "frame.h"
+
+static const char *msgNames[] = {"BT_DOWN", "BT_UP", "CHATTER", "FAULT"};
+
+typedef struct streamStats_s {
+	uint64_t	events;
+	uint64_t	frames;
+	uint64_t	crcErrors;
+	uint64_t	lostFrames;
+	int			lastSeq;
+} streamStats_t;
+
+static uint64_t nowNs(void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static speed_t toSpeed(long baud) {
+	switch (baud) {
+		case 9600:		return B9600;
+		case 19200:		return B19200;
+		case 38400:		return B38400;
+		case 57600:		return B57600;
+		case 230400:	return B230400;
+		case 460800:	return B460800;
+		case 921600:	return B921600;
+		default:		return B115200;
+	}
+}
+
+static int setRaw(int fd, long baud) {
+	struct termios tio;
+
+	if (tcgetattr(fd, &tio) < 0) {
+		return -1;
+	}
+	cfmakeraw(&tio);
+	cfsetispeed(&tio, toSpeed(baud));
+	cfsetospeed(&tio, toSpeed(baud));
+	tio.c_cc[VMIN] = 1;
+	tio.c_cc[VTIME] = 0;
+	return tcsetattr(fd, TCSANOW, &tio);
+}
+
+/*
+ * Account for one decoded frame: sequence gap detection and event count
+ */
+static void countFrame(streamStats_t *stats, frameDecoder_t *decoder) {
+	int seq = FRAME_SEQ(decoder);
+
+	if (stats->lastSeq >= 0) {
+		stats->lostFrames += (uint8_t) (seq - stats->lastSeq - 1);
+	}
+	stats->lastSeq = seq;
+	stats->frames++;
+	stats->events += FRAME_NEVENTS(decoder);
+}
+
+/*
+ * Decode a live stream from the firmware
+ */
+static int monitor(const char *tty, long baud) {
+	frameDecoder_t	decoder;
+	streamStats_t	stats = {0, 0, 0, 0, -1};
+	uint8_t			buf[256];
+	uint64_t		lastReport = nowNs(), lastEvents = 0;
+	ssize_t			n, i;
+	int				fd, e;
+
+	fd = open(tty, O_RDONLY | O_NOCTTY);
+	if (fd < 0 || setRaw(fd, baud) < 0) {
+		perror(tty);
+		return 1;
+	}
+	initializeFrameDecoder(&decoder);
+
+	while ((n = read(fd, buf, sizeof buf)) > 0) {
+		for (i = 0; i < n; i++) {
+			switch (decodeFrameByte(&decoder, buf[i])) {
+				case 1:
+					countFrame(&stats, &decoder);
+					for (e = 0; e < FRAME_NEVENTS(&decoder); e++) {
+						uint8_t id = FRAME_EVENT_ID(&decoder, e), val = FRAME_EVENT_VAL(&decoder, e);
+						printf("keypad %u ", FRAME_EVENT_DEV(&decoder, e));
+						if (id < sizeof msgNames / sizeof msgNames[0]) {
+							printf("%-8s 0x%02x '%c'\n", msgNames[id], val, (val >= 0x20 && val < 0x7f) ? val : '.');
+						} else {
+							printf("MSG_%-4u 0x%02x\n", id, val);
+						}
+					}
+					break;
+				case 0xFF:
+					stats.crcErrors++;
+					break;
+				default:
+					break;
+			}
+		}
+		if (nowNs() - lastReport >= 1000000000ull) {
+			fprintf(stderr, "%llu ev/s, %llu frames, %llu crc errors, %llu lost frames\n",
+					(unsigned long long) (stats.events - lastEvents), (unsigned long long) stats.frames,
+					(unsigned long long) stats.crcErrors, (unsigned long long) stats.lostFrames);
+			lastEvents = stats.events;
+			lastReport = nowNs();
+		}
+		fflush(stdout);
+	}
+	close(fd);
+	return 0;
+}
+
+/*
+ * Loopback self test. The writer produces the events faster than the link sends them, so it always fills the frames
+ * up to FRAME_MAX_EVENTS: the worst case of the firmware UART module, where every frame is full by the time the one
+ * in flight is sent. The coalescing of a lighter load is not modeled. Each frame records its creation time, indexed
+ * by SEQ, and the writer stays less than 256 frames ahead of the reader so that a time is read before its slot is
+ * reused. The times and the frame counts are shared with atomic loads and stores. The writer raises done when it
+ * stops, after the last frame or a failed write, and the reader polls the pty so that it stops too.
+ */
+typedef struct loopback_s {
+	int			fd;
+	uint64_t	nEvents;
+	uint64_t	frameTime[256];
+	uint64_t	framesRead;						// decoded or rejected by the reader
+	int			done;							// the writer has stopped
+	int			stop;							// the reader has stopped
+} loopback_t;
+
+static void *loopbackWriter(void *arg) {
+	loopback_t		*lb = arg;
+	frameBuffer_t	frame;
+	uint64_t		produced = 0, written = 0;
+	uint8_t			seq = 0, length;
+	ssize_t			w, off;
+
+	while (produced < lb->nEvents) {
+		while (written - __atomic_load_n(&lb->framesRead, __ATOMIC_ACQUIRE) >= 256) {
+			if (__atomic_load_n(&lb->stop, __ATOMIC_ACQUIRE)) {
+				__atomic_store_n(&lb->done, 1, __ATOMIC_RELEASE);
+				return NULL;
+			}
+			sched_yield();
+		}
+		initializeFrame(&frame);
+		__atomic_store_n(&lb->frameTime[seq], nowNs(), __ATOMIC_RELEASE);
+		while ((produced < lb->nEvents) &&
+			   (putEventInFrame(&frame, (produced & 1) ? 1 : 0, (produced >> 1) & 1, '0' + (produced % 10)) != 0xFF)) {
+			produced++;
+		}
+		length = sealFrame(&frame, seq++);
+		written++;
+		for (off = 0; off < length; off += w) {
+			w = write(lb->fd, frame.data + off, length - off);
+			if (w <= 0) {
+				perror("pty master");
+				__atomic_store_n(&lb->done, 1, __ATOMIC_RELEASE);
+				return NULL;
+			}
+		}
+	}
+	__atomic_store_n(&lb->done, 1, __ATOMIC_RELEASE);
+	return NULL;
+}
+
+static int loopback(uint64_t nEvents) {
+	loopback_t		lb;
+	pthread_t		writer;
+	frameDecoder_t	decoder;
+	streamStats_t	stats = {0, 0, 0, 0, -1};
+	uint8_t			buf[4096];
+	uint64_t		start, end, lat, latSum = 0, latMax = 0;
+	ssize_t			n, i;
+	int				slave, ready;
+	struct pollfd	pfd;
+
+	memset(&lb, 0, sizeof lb);
+	lb.nEvents = nEvents;
+	lb.fd = posix_openpt(O_RDWR | O_NOCTTY);
+	if (lb.fd < 0 || grantpt(lb.fd) < 0 || unlockpt(lb.fd) < 0) {
+		perror("posix_openpt");
+		return 1;
+	}
+	slave = open(ptsname(lb.fd), O_RDONLY | O_NOCTTY);
+	if (slave < 0 || setRaw(slave, 115200) < 0 || setRaw(lb.fd, 115200) < 0) {
+		perror("pty slave");
+		return 1;
+	}
+	initializeFrameDecoder(&decoder);
+
+	start = nowNs();
+	pthread_create(&writer, NULL, loopbackWriter, &lb);
+
+	pfd.fd = slave;
+	pfd.events = POLLIN;
+	while (stats.events < nEvents) {
+		ready = poll(&pfd, 1, 100);
+		if (ready == 0 && __atomic_load_n(&lb.done, __ATOMIC_ACQUIRE)) {
+			break;										// the writer stopped and everything sent was read
+		}
+		if (ready <= 0) {
+			continue;
+		}
+		if ((n = read(slave, buf, sizeof buf)) <= 0) {
+			break;
+		}
+		for (i = 0; i < n; i++) {
+			switch (decodeFrameByte(&decoder, buf[i])) {
+				case 1:
+					lat = nowNs() - __atomic_load_n(&lb.frameTime[FRAME_SEQ(&decoder)], __ATOMIC_ACQUIRE);
+					countFrame(&stats, &decoder);
+					latSum += lat;
+					if (lat > latMax) {
+						latMax = lat;
+					}
+					__atomic_store_n(&lb.framesRead, stats.frames + stats.crcErrors, __ATOMIC_RELEASE);
+					break;
+				case 0xFF:
+					stats.crcErrors++;
+					__atomic_store_n(&lb.framesRead, stats.frames + stats.crcErrors, __ATOMIC_RELEASE);
+					break;
+				default:
+					break;
+			}
+		}
+	}
+	end = nowNs();
+	__atomic_store_n(&lb.stop, 1, __ATOMIC_RELEASE);
+	pthread_join(writer, NULL);
+
+	printf("{\"events\": %llu, \"frames\": %llu, \"crc_errors\": %llu, \"lost_frames\": %llu, "
+		   "\"events_per_sec\": %.0f, \"latency_mean_us\": %.1f, \"latency_max_us\": %.1f}\n",
+		   (unsigned long long) stats.events, (unsigned long long) stats.frames,
+		   (unsigned long long) stats.crcErrors, (unsigned long long) stats.lostFrames,
+		   stats.events / ((end - start) / 1e9),
+		   stats.frames ? latSum / 1e3 / stats.frames : 0.0, latMax / 1e3);
+
+	close(slave);
+	close(lb.fd);
+	return (stats.events == nEvents && stats.crcErrors == 0 && stats.lostFrames == 0) ? 0 : 1;
+}
+
+int main(int argc, char **argv) {
+
+	if (argc >= 2 && !strcmp(argv[1], "--loopback")) {
+		return loopback(argc >= 3 ? strtoull(argv[2], NULL, 0) : 1000000);
+	}
+	if (argc >= 2) {
+		return monitor(argv[1], argc >= 3 ? strtol(argv[2], NULL, 0) : 115200);
+	}
+	fprintf(stderr, "usage: %s <tty> [baudrate] | --loopback [events]\n", argv[0]);
+	return 2;
+}
@@ -0,0 +1,283 @@
+/*
+ * stm32f10x.h
+ *
+ *  Author: Ahmed Talaat (aa_talaat@yahoo.com)
+ *
+ * Host stand-in for the device header. The modules that do not access any peripheral (queues.c, ladder.c, ...) only
+ * need the fixed width integer types from it, which lets them be built and exercised on a PC.
+ *
+ * It also declares the subset of the StdPeriph library and of the CMSIS core used by the keypad firmware, so that the
+ * matrix keypad path (buttons.c, TIM4.c, stm32f10x_it.c, ...) can run unchanged against the peripheral models of
+ * stm32sim.c. The peripherals are plain structures in host memory: only the registers read or written by the firmware
+ * are kept, not their layout.
+ */
+
+#ifndef __STM32F10x_H
+#define __STM32F10x_H
+
+#include <stdint.h>
+
+typedef enum {RESET = 0, SET = !RESET} FlagStatus, ITStatus;
+typedef enum {DISABLE = 0, ENABLE = !DISABLE} FunctionalState;
+
+#define __IO	volatile
+
+/* Peripheral registers ------------------------------------------------------*/
+typedef struct { __IO uint32_t CRL, CRH, IDR, ODR, BSRR, BRR, LCKR; } GPIO_TypeDef;
+typedef struct { __IO uint32_t IMR, EMR, RTSR, FTSR, SWIER, PR; } EXTI_TypeDef;
+typedef struct { __IO uint16_t CR1, CR2, SMCR, DIER, SR, EGR, CCMR1, CCMR2, CCER, CNT, PSC, ARR, RCR,
+							   CCR1, CCR2, CCR3, CCR4; } TIM_TypeDef;
+typedef struct { __IO uint16_t SR, DR, BRR, CR1, CR2, CR3, GTPR; } USART_TypeDef;
+typedef struct { __IO uint32_t CCR, CNDTR, CPAR, CMAR; } DMA_Channel_TypeDef;
+typedef struct { __IO uint32_t ISR, IFCR; } DMA_TypeDef;
+typedef struct { __IO uint32_t SR, CR1, CR2, DR; } ADC_TypeDef;
+typedef struct { __IO uint32_t CPUID, ICSR, VTOR, AIRCR, SCR, CCR; } SCB_Type;
+typedef struct { __IO uint32_t CTRL, CYCCNT; } DWT_Type;
+typedef struct { __IO uint32_t DHCSR, DCRSR, DCRDR, DEMCR; } CoreDebug_Type;
+typedef struct { __IO uint32_t CTRL, LOAD, VAL, CALIB; } SysTick_Type;
+typedef struct { __IO uint16_t CRH, CRL, PRLH, PRLL, DIVH, DIVL, CNTH, CNTL, ALRH, ALRL; } RTC_TypeDef;
+
+extern GPIO_TypeDef			simGPIO[4];
+extern EXTI_TypeDef			simEXTI;
+extern TIM_TypeDef			simTIM3, simTIM4;
+extern USART_TypeDef		simUSART1;
+extern DMA_TypeDef			simDMA1;
+extern DMA_Channel_TypeDef	simDMA1_Channel1, simDMA1_Channel4;
+extern ADC_TypeDef			simADC1;
+extern SCB_Type				simSCB;
+extern DWT_Type				simDWT;
+extern CoreDebug_Type		simCoreDebug;
+extern SysTick_Type			simSysTick;
+extern RTC_TypeDef			simRTC;
+
+#define GPIOA				(&simGPIO[0])
+#define GPIOB				(&simGPIO[1])
+#define GPIOC				(&simGPIO[2])
+#define GPIOD				(&simGPIO[3])
+#define EXTI				(&simEXTI)
+#define TIM3				(&simTIM3)
+#define TIM4				(&simTIM4)
+#define USART1				(&simUSART1)
+#define DMA1				(&simDMA1)
+#define DMA1_Channel1		(&simDMA1_Channel1)
+#define DMA1_Channel4		(&simDMA1_Channel4)
+#define ADC1				(&simADC1)
+#define SCB					(&simSCB)
+#define DWT					(&simDWT)
+#define CoreDebug			(&simCoreDebug)
+#define SysTick				(&simSysTick)
+#define RTC					(&simRTC)
+
+extern uint32_t SystemCoreClock;
+
+/* CMSIS core -----------------------------------------------------------------*/
+typedef enum {
+	PendSV_IRQn = -2, SysTick_IRQn = -1, DMA1_Channel1_IRQn = 11, DMA1_Channel4_IRQn = 14, ADC1_IRQn = 18,
+	EXTI9_5_IRQn = 23, TIM3_IRQn = 29, TIM4_IRQn = 30, USART1_IRQn = 37, EXTI15_10_IRQn = 40,
+	RTCAlarm_IRQn = 41
+} IRQn_Type;
+
+#define SCB_ICSR_PENDSVSET			0x10000000
+#define SCB_ICSR_PENDSVCLR			0x08000000
+#define CoreDebug_DEMCR_TRCENA		0x01000000
+#define DWT_CTRL_CYCCNTENA			0x00000001
+#define SysTick_CTRL_ENABLE_Msk		0x00000001
+#define SysTick_CTRL_TICKINT_Msk	0x00000002
+#define SysTick_CTRL_CLKSOURCE_Msk	0x00000004
+
+void NVIC_SetPriority(IRQn_Type IRQn, uint32_t priority);
+void NVIC_EnableIRQ(IRQn_Type IRQn);
+void NVIC_DisableIRQ(IRQn_Type IRQn);
+uint32_t SysTick_Config(uint32_t ticks);
+
+void __disable_irq(void);
+void __enable_irq(void);
+uint32_t __get_PRIMASK(void);
+void __set_PRIMASK(uint32_t priMask);
+void __WFI(void);
+
+static inline uint32_t __CLZ(uint32_t value) {
+	return value ? (uint32_t) __builtin_clz(value) : 32;
+}
+
+/* GPIO -----------------------------------------------------------------------*/
+typedef enum { GPIO_Speed_10MHz = 1, GPIO_Speed_2MHz, GPIO_Speed_50MHz } GPIOSpeed_TypeDef;
+typedef enum {
+	GPIO_Mode_AIN = 0x0, GPIO_Mode_IN_FLOATING = 0x04, GPIO_Mode_IPD = 0x28, GPIO_Mode_IPU = 0x48,
+	GPIO_Mode_Out_OD = 0x14, GPIO_Mode_Out_PP = 0x10, GPIO_Mode_AF_OD = 0x1C, GPIO_Mode_AF_PP = 0x18
+} GPIOMode_TypeDef;
+typedef struct { uint16_t GPIO_Pin; GPIOSpeed_TypeDef GPIO_Speed; GPIOMode_TypeDef GPIO_Mode; } GPIO_InitTypeDef;
+
+#define GPIO_Pin_0					((uint16_t) 0x0001)
+#define GPIO_Pin_1					((uint16_t) 0x0002)
+#define GPIO_Pin_2					((uint16_t) 0x0004)
+#define GPIO_Pin_3					((uint16_t) 0x0008)
+#define GPIO_Pin_4					((uint16_t) 0x0010)
+#define GPIO_Pin_5					((uint16_t) 0x0020)
+#define GPIO_Pin_6					((uint16_t) 0x0040)
+#define GPIO_Pin_7					((uint16_t) 0x0080)
+#define GPIO_Pin_8					((uint16_t) 0x0100)
+#define GPIO_Pin_9					((uint16_t) 0x0200)
+#define GPIO_Pin_10					((uint16_t) 0x0400)
+#define GPIO_Pin_11					((uint16_t) 0x0800)
+#define GPIO_Pin_12					((uint16_t) 0x1000)
+#define GPIO_Pin_13					((uint16_t) 0x2000)
+#define GPIO_Pin_14					((uint16_t) 0x4000)
+#define GPIO_Pin_15					((uint16_t) 0x8000)
+#define GPIO_Pin_All				((uint16_t) 0xFFFF)
+
+#define GPIO_PortSourceGPIOA		((uint8_t) 0x00)
+#define GPIO_PortSourceGPIOB		((uint8_t) 0x01)
+#define GPIO_PortSourceGPIOC		((uint8_t) 0x02)
+#define GPIO_PortSourceGPIOD		((uint8_t) 0x03)
+
+void GPIO_Init(GPIO_TypeDef *GPIOx, GPIO_InitTypeDef *GPIO_InitStruct);
+uint8_t GPIO_ReadInputDataBit(GPIO_TypeDef *GPIOx, uint16_t GPIO_Pin);
+uint16_t GPIO_ReadInputData(GPIO_TypeDef *GPIOx);
+void GPIO_SetBits(GPIO_TypeDef *GPIOx, uint16_t GPIO_Pin);
+void GPIO_ResetBits(GPIO_TypeDef *GPIOx, uint16_t GPIO_Pin);
+void GPIO_EXTILineConfig(uint8_t GPIO_PortSource, uint8_t GPIO_PinSource);
+
+/* RCC ------------------------------------------------------------------------*/
+#define RCC_APB2Periph_AFIO			((uint32_t) 0x00000001)
+#define RCC_APB2Periph_GPIOA		((uint32_t) 0x00000004)
+#define RCC_APB2Periph_GPIOB		((uint32_t) 0x00000008)
+#define RCC_APB2Periph_GPIOC		((uint32_t) 0x00000010)
+#define RCC_APB2Periph_GPIOD		((uint32_t) 0x00000020)
+#define RCC_APB2Periph_ADC1			((uint32_t) 0x00000200)
+#define RCC_APB2Periph_USART1		((uint32_t) 0x00004000)
+#define RCC_APB1Periph_TIM3			((uint32_t) 0x00000002)
+#define RCC_APB1Periph_TIM4			((uint32_t) 0x00000004)
+#define RCC_APB1Periph_BKP			((uint32_t) 0x08000000)
+#define RCC_APB1Periph_PWR			((uint32_t) 0x10000000)
+#define RCC_AHBPeriph_DMA1			((uint32_t) 0x00000001)
+
+#define RCC_FLAG_HSIRDY				((uint8_t) 0x21)
+#define RCC_FLAG_HSERDY				((uint8_t) 0x31)
+#define RCC_FLAG_LSIRDY				((uint8_t) 0x61)
+#define RCC_RTCCLKSource_LSI		((uint32_t) 0x00000200)
+#define RCC_SYSCLKSource_HSI		((uint32_t) 0x00000000)
+#define RCC_HSE_OFF					((uint32_t) 0x00000000)
+#define RCC_PCLK2_Div2				((uint32_t) 0x00000000)
+
+void RCC_APB2PeriphClockCmd(uint32_t RCC_APB2Periph, FunctionalState NewState);
+void RCC_APB1PeriphClockCmd(uint32_t RCC_APB1Periph, FunctionalState NewState);
+void RCC_AHBPeriphClockCmd(uint32_t RCC_AHBPeriph, FunctionalState NewState);
+void RCC_HSICmd(FunctionalState NewState);
+void RCC_HSEConfig(uint32_t RCC_HSE);
+void RCC_SYSCLKConfig(uint32_t RCC_SYSCLKSource);
+void RCC_ADCCLKConfig(uint32_t RCC_PCLK2);
+FlagStatus RCC_GetFlagStatus(uint8_t RCC_FLAG);
+void RCC_LSICmd(FunctionalState NewState);
+void RCC_RTCCLKConfig(uint32_t RCC_RTCCLKSource);
+void RCC_RTCCLKCmd(FunctionalState NewState);
+
+/* EXTI and NVIC --------------------------------------------------------------*/
+typedef enum { EXTI_Mode_Interrupt = 0x00, EXTI_Mode_Event = 0x04 } EXTIMode_TypeDef;
+typedef enum { EXTI_Trigger_Rising = 0x08, EXTI_Trigger_Falling = 0x0C, EXTI_Trigger_Rising_Falling = 0x10 } EXTITrigger_TypeDef;
+#define EXTI_Line17					((uint32_t) 0x20000)		// RTC alarm
+
+typedef struct { uint32_t EXTI_Line; EXTIMode_TypeDef EXTI_Mode; EXTITrigger_TypeDef EXTI_Trigger; FunctionalState EXTI_LineCmd; } EXTI_InitTypeDef;
+
+void EXTI_Init(EXTI_InitTypeDef *EXTI_InitStruct);
+ITStatus EXTI_GetITStatus(uint32_t EXTI_Line);
+void EXTI_ClearITPendingBit(uint32_t EXTI_Line);
+void EXTI_GenerateSWInterrupt(uint32_t EXTI_Line);
+
+typedef struct { uint8_t NVIC_IRQChannel, NVIC_IRQChannelPreemptionPriority, NVIC_IRQChannelSubPriority;
+				 FunctionalState NVIC_IRQChannelCmd; } NVIC_InitTypeDef;
+
+#define NVIC_PriorityGroup_2		((uint32_t) 0x500)
+
+void NVIC_Init(NVIC_InitTypeDef *NVIC_InitStruct);
+void NVIC_PriorityGroupConfig(uint32_t NVIC_PriorityGroup);
+
+/* TIM ------------------------------------------------------------------------*/
+typedef struct { uint16_t TIM_Prescaler, TIM_CounterMode, TIM_Period, TIM_ClockDivision; uint8_t TIM_RepetitionCounter; } TIM_TimeBaseInitTypeDef;
+
+#define TIM_CounterMode_Up			((uint16_t) 0x0000)
+#define TIM_IT_Update				((uint16_t) 0x0001)
+#define TIM_IT_CC1					((uint16_t) 0x0002)
+#define TIM_IT_CC2					((uint16_t) 0x0004)
+#define TIM_IT_CC3					((uint16_t) 0x0008)
+#define TIM_IT_CC4					((uint16_t) 0x0010)
+#define TIM_TRGOSource_Update		((uint16_t) 0x0020)
+#define TIM_CR1_CEN					((uint16_t) 0x0001)
+
+void TIM_TimeBaseInit(TIM_TypeDef *TIMx, TIM_TimeBaseInitTypeDef *TIM_TimeBaseInitStruct);
+void TIM_Cmd(TIM_TypeDef *TIMx, FunctionalState NewState);
+void TIM_ITConfig(TIM_TypeDef *TIMx, uint16_t TIM_IT, FunctionalState NewState);
+ITStatus TIM_GetITStatus(TIM_TypeDef *TIMx, uint16_t TIM_IT);
+void TIM_ClearITPendingBit(TIM_TypeDef *TIMx, uint16_t TIM_IT);
+void TIM_SetCounter(TIM_TypeDef *TIMx, uint16_t Counter);
+uint16_t TIM_GetCounter(TIM_TypeDef *TIMx);
+void TIM_SetCompare1(TIM_TypeDef *TIMx, uint16_t Compare1);
+void TIM_SetCompare2(TIM_TypeDef *TIMx, uint16_t Compare2);
+void TIM_SetCompare3(TIM_TypeDef *TIMx, uint16_t Compare3);
+void TIM_SetCompare4(TIM_TypeDef *TIMx, uint16_t Compare4);
+void TIM_SelectOutputTrigger(TIM_TypeDef *TIMx, uint16_t TIM_TRGOSource);
+
+/* PWR and RTC ----------------------------------------------------------------*/
+#define PWR_Regulator_LowPower		((uint32_t) 0x00000001)
+#define PWR_STOPEntry_WFI			((uint8_t) 0x01)
+#define RTC_FLAG_ALR				((uint16_t) 0x0002)
+
+void PWR_EnterSTOPMode(uint32_t PWR_Regulator, uint8_t PWR_STOPEntry);
+void PWR_BackupAccessCmd(FunctionalState NewState);
+void RTC_WaitForSynchro(void);
+void RTC_WaitForLastTask(void);
+void RTC_SetPrescaler(uint32_t PrescalerValue);
+uint32_t RTC_GetCounter(void);
+void RTC_SetAlarm(uint32_t AlarmValue);
+void RTC_ClearFlag(uint16_t RTC_FLAG);
+
+/* USART and DMA (USART1 transmit by DMA1 channel 4 modelled), ADC (no effect) -*/
+typedef struct { uint32_t USART_BaudRate; uint16_t USART_WordLength, USART_StopBits, USART_Parity, USART_Mode,
+				 USART_HardwareFlowControl; } USART_InitTypeDef;
+
+#define USART_WordLength_8b			((uint16_t) 0x0000)
+#define USART_StopBits_1			((uint16_t) 0x0000)
+#define USART_Parity_No				((uint16_t) 0x0000)
+#define USART_Mode_Tx				((uint16_t) 0x0008)
+#define USART_HardwareFlowControl_None	((uint16_t) 0x0000)
+#define USART_FLAG_TC				((uint16_t) 0x0040)
+#define USART_DMAReq_Tx				((uint16_t) 0x0080)
+
+void USART_Init(USART_TypeDef *USARTx, USART_InitTypeDef *USART_InitStruct);
+void USART_Cmd(USART_TypeDef *USARTx, FunctionalState NewState);
+void USART_DMACmd(USART_TypeDef *USARTx, uint16_t USART_DMAReq, FunctionalState NewState);
+FlagStatus USART_GetFlagStatus(USART_TypeDef *USARTx, uint16_t USART_FLAG);
+
+typedef struct { uint32_t DMA_PeripheralBaseAddr, DMA_MemoryBaseAddr, DMA_DIR, DMA_BufferSize, DMA_PeripheralInc,
+				 DMA_MemoryInc, DMA_PeripheralDataSize, DMA_MemoryDataSize, DMA_Mode, DMA_Priority, DMA_M2M; } DMA_InitTypeDef;
+
+#define DMA_DIR_PeripheralDST		((uint32_t) 0x00000010)
+#define DMA_DIR_PeripheralSRC		((uint32_t) 0x00000000)
+#define DMA_PeripheralInc_Disable	((uint32_t) 0x00000000)
+#define DMA_MemoryInc_Enable		((uint32_t) 0x00000080)
+#define DMA_PeripheralDataSize_Byte	((uint32_t) 0x00000000)
+#define DMA_PeripheralDataSize_HalfWord	((uint32_t) 0x00000100)
+#define DMA_MemoryDataSize_Byte		((uint32_t) 0x00000000)
+#define DMA_MemoryDataSize_HalfWord	((uint32_t) 0x00000400)
+#define DMA_Mode_Normal				((uint32_t) 0x00000000)
+#define DMA_Mode_Circular			((uint32_t) 0x00000020)
+#define DMA_Priority_Low			((uint32_t) 0x00000000)
+#define DMA_Priority_Medium			((uint32_t) 0x00001000)
+#define DMA_M2M_Disable				((uint32_t) 0x00000000)
+#define DMA_IT_TC					((uint32_t) 0x00000002)
+#define DMA_IT_HT					((uint32_t) 0x00000004)
+#define DMA1_IT_GL1					((uint32_t) 0x00000001)
+#define DMA1_IT_TC1					((uint32_t) 0x00000002)
+#define DMA1_IT_HT1					((uint32_t) 0x00000004)
+#define DMA1_IT_GL4					((uint32_t) 0x00001000)
+#define DMA1_IT_TC4					((uint32_t) 0x00002000)
+
+void DMA_DeInit(DMA_Channel_TypeDef *DMAy_Channelx);
+void DMA_Init(DMA_Channel_TypeDef *DMAy_Channelx, DMA_InitTypeDef *DMA_InitStruct);
+void DMA_Cmd(DMA_Channel_TypeDef *DMAy_Channelx, FunctionalState NewState);
+void DMA_ITConfig(DMA_Channel_TypeDef *DMAy_Channelx, uint32_t DMA_IT, FunctionalState NewState);
+void DMA_SetCurrDataCounter(DMA_Channel_TypeDef *DMAy_Channelx, uint16_t DataNumber);
+ITStatus DMA_GetITStatus(uint32_t DMAy_IT);
+void DMA_ClearITPendingBit(uint32_t DMAy_IT);
+
+#endif /* __STM32F10x_H */
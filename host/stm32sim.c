@@ -0,0 +1,909 @@
+/*
+ * stm32sim.c
+ *
+ *  Author: Ahmed Talaat (aa_talaat@yahoo.com)
+ *
+ * Host models of the STM32F100 peripherals used by the matrix keypad path, to run the firmware unchanged on a PC:
+ *	- GPIO: the level of every pin is computed from its mode (GPIO_Init), its output register and the key contacts of
+ *	  the keypad matrices attached to the port. A closed contact connects a row pin to a column pin: a pin driven low
+ *	  pulls the whole net low, otherwise the pull-ups win. An external source (simDrivePin, e.g. noise coupled on a
+ *	  keypad wire) overrides the whole net.
+ *	- EXTI: the edges of the pin levels set the pending bits of the lines linked to the port (GPIO_EXTILineConfig).
+ *	- TIM4: counter, prescaler, auto-reload and the 4 compare channels.
+ *	- SysTick, PendSV and PRIMASK.
+ *	- USART1 transmitting by DMA1 channel 4: a transfer lasts 10 bit times per byte at the baud rate of USART_Init, then
+ *	  sets the transfer complete flag of the channel, and USART_FLAG_TC. The bytes themselves are not read.
+ *	- RTC: the counter, clocked by the LSI at SIM_LSI_HZ through the prescaler, and the alarm, which sets EXTI line 17.
+ *	  It keeps counting in STOP mode, and its waits for the synchronization of the registers take no time.
+ *	- Power: the run, sleep (__WFI) and STOP (PWR_EnterSTOPMode) states, and the peripheral clocks enabled through the
+ *	  RCC. The charge drawn is integrated from a current table (simCurrents), see Energy below.
+ *
+ * Time is discrete events in ns: the key contacts are changed by the caller (simSetContact), and simAdvance() runs the
+ * timer ticks up to a date. After every change, the pending and enabled interrupts are handled in priority order,
+ * then simOnInterrupt is called, like the main loop woken up by the interrupt.
+ *
+ * The handlers run in no simulated time. Their CPU time is accounted from a cost per call (simIrqCycles). The costs are
+ * estimates counted from the C code of each handler, not measured: replace them with the counts of a KEYPAD_PROFILE
+ * build on the target before trusting the CPU shares, latencies and energy derived from them. The ADC calls have no
+ * effect, and the NVIC enables are not checked.
+ *
+ * Energy: the device draws the core current of its power state (per MHz of SystemCoreClock in run and sleep), plus the
+ * current of every peripheral whose clock is enabled in run and sleep. In STOP mode only stopUa is drawn, and the
+ * timers do not count. rtcUa is added in every state once the RTC clock is enabled. An interrupt wakes the device up in run state (after stopWakeUs at run current from STOP),
+ * its handlers are drawn at run current for their CPU time, then simOnInterrupt decides of the next state like the
+ * main loop does. The main loop itself runs in no time: a main loop that does not sleep stays in run state.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "stm32f10x.h"
+#include "stm32f10x_it.h"
+#include "stm32sim.h"
+
+void EXTI9_5_IRQHandler(void);
+void EXTI15_10_IRQHandler(void);
+void TIM4_IRQHandler(void);
+void DMA1_Channel4_IRQHandler(void);
+void RTCAlarm_IRQHandler(void);
+
+GPIO_TypeDef		simGPIO[4];
+EXTI_TypeDef		simEXTI;
+TIM_TypeDef			simTIM3, simTIM4;
+USART_TypeDef		simUSART1;
+DMA_TypeDef			simDMA1;
+DMA_Channel_TypeDef	simDMA1_Channel1, simDMA1_Channel4;
+ADC_TypeDef			simADC1;
+SCB_Type			simSCB;
+DWT_Type			simDWT;
+CoreDebug_Type		simCoreDebug;
+SysTick_Type		simSysTick;
+RTC_TypeDef			simRTC;
+
+uint32_t			SystemCoreClock;
+
+simTime_t			simNow;
+simStats_t			simStats;
+void				(*simOnInterrupt)(void);
+
+simPower_t			simPower;
+simEnergy_t			simEnergy;
+
+simCurrents_t		simCurrents = {
+	.runUaPerMhz = 330, .sleepUaPerMhz = 110, .stopUa = 14, .stopWakeUs = 5.4, .rtcUa = 0.7,
+	.apb1UaPerMhz = {[1] = 17, [2] = 17, [28] = 1},					// TIM3, TIM4, PWR
+	.apb2UaPerMhz = {[0] = 3, [2] = 7, [3] = 7, [4] = 7, [5] = 7,	// AFIO, GPIOA to GPIOD
+					 [9] = 17, [14] = 14},							// ADC1, USART1
+	.ahbUaPerMhz = {[0] = 6},										// DMA1
+	.batteryMah = 225												// CR2032 coin cell
+};
+
+/* Estimated costs, see above */
+#ifdef KEYPAD_TOP_HALF_DECODE
+#define SIM_TIM4_CYCLES		(90 + 650)					// the bottom half runs in the TIM4 handler, PendSV is not used
+#else
+#define SIM_TIM4_CYCLES		90
+#endif
+
+uint32_t			simIrqCycles[SIM_IRQ_COUNT] = {
+	[SIM_IRQ_TIM4] = SIM_TIM4_CYCLES, [SIM_IRQ_DMA1_CH4] = 40, [SIM_IRQ_EXTI9_5] = 70, [SIM_IRQ_EXTI15_10] = 70,
+	[SIM_IRQ_RTC_ALARM] = 40, [SIM_IRQ_SYSTICK] = 20, [SIM_IRQ_PENDSV] = 650
+};
+
+typedef struct simMatrix_s {
+	uint8_t		port;							// 0 for GPIOA, ... 0xFF when not attached
+	uint8_t		rowPin[4];						// pin numbers
+	uint8_t		colPin[4];
+	uint8_t		contact[16];					// 1 when the key (4*row+col) contact is closed
+} simMatrix_t;
+
+static simMatrix_t	simMatrix[SIM_MAX_MATRIX];
+static uint8_t		pinMode[4][16];
+static uint8_t		extiPort[16];				// AFIO EXTICR: port linked to each EXTI line
+static uint16_t		extLow[4], extHigh[4];		// pins driven by an external source
+static uint32_t		primask;
+static uint8_t		sysTickPending;
+static uint8_t		inHandlers;
+static simTime_t	tim4NextTick, sysTickNext;
+static simTime_t	dma4Done;					// end of the USART1 transfer of DMA1 channel 4
+static uint32_t		usartBaud;
+static uint8_t		rtcRunning;					// LSI and RTC clock enabled
+static uint32_t		rtcPrescaler, rtcBase;		// PRL, and the counter at rtcSince
+static simTime_t	rtcSince, rtcAlarmAt;		// date of the last prescaler change, and of the next alarm
+static uint32_t		rccApb1, rccApb2, rccAhb;	// peripheral clock enables
+static simTime_t	powerSince, stopSince;
+
+#define SIM_DMA_CCR_EN		((uint32_t) 0x00000001)
+#define SIM_LSI_HZ			40000
+
+static void (* const simHandlers[SIM_IRQ_COUNT])(void) = {
+	TIM4_IRQHandler, DMA1_Channel4_IRQHandler, EXTI9_5_IRQHandler, EXTI15_10_IRQHandler, RTCAlarm_IRQHandler,
+	SysTick_Handler, PendSV_Handler
+};
+
+static uint8_t portIndex(GPIO_TypeDef *GPIOx);
+static uint8_t pinIndex(uint16_t pin);
+static void updatePort(uint8_t port);
+static simTime_t tim4Period(void);
+static void tim4Tick(void);
+static simTime_t rtcTickNs(void);
+static uint32_t rtcCounter(void);
+static int8_t pendingIrq(void);
+static void wakeUp(void);
+static double peripheralUa(void);
+
+/*
+ * Reset state of the device: all the pins floating inputs, timers stopped, no key pressed
+ */
+void simReset(void) {
+	uint8_t	i;
+
+	memset(simGPIO, 0, sizeof simGPIO);
+	memset(&simEXTI, 0, sizeof simEXTI);
+	memset(&simTIM3, 0, sizeof simTIM3);
+	memset(&simTIM4, 0, sizeof simTIM4);
+	memset(&simSCB, 0, sizeof simSCB);
+	memset(&simSysTick, 0, sizeof simSysTick);
+	memset(&simUSART1, 0, sizeof simUSART1);
+	memset(&simDMA1, 0, sizeof simDMA1);
+	memset(&simDMA1_Channel4, 0, sizeof simDMA1_Channel4);
+	memset(&simRTC, 0, sizeof simRTC);
+	memset(&simStats, 0, sizeof simStats);
+	memset(&simEnergy, 0, sizeof simEnergy);
+	memset(simMatrix, 0, sizeof simMatrix);
+	memset(pinMode, GPIO_Mode_IN_FLOATING, sizeof pinMode);
+	memset(extiPort, 0, sizeof extiPort);
+	memset(extLow, 0, sizeof extLow);
+	memset(extHigh, 0, sizeof extHigh);
+	for (i = 0; i < SIM_MAX_MATRIX; i++) {
+		simMatrix[i].port = 0xFF;
+	}
+	SystemCoreClock = 8000000;
+	simTIM4.ARR = 0xFFFF;
+	simNow = 0;
+	primask = 0;
+	sysTickPending = 0;
+	inHandlers = 0;
+	tim4NextTick = SIM_NEVER;
+	sysTickNext = SIM_NEVER;
+	dma4Done = SIM_NEVER;
+	usartBaud = 0;
+	rtcRunning = 0;
+	rtcPrescaler = 0x7FFF;
+	rtcBase = 0;
+	rtcSince = 0;
+	rtcAlarmAt = SIM_NEVER;
+	simPower = SIM_RUN;
+	powerSince = 0;
+	rccApb1 = rccApb2 = rccAhb = 0;
+	for (i = 0; i < 4; i++) {
+		updatePort(i);
+	}
+}
+
+/*
+ * Wire a 4x4 keypad matrix to a port, with the same pin masks as the firmware keypadConfig_t
+ */
+void simAttachMatrix(uint8_t id, GPIO_TypeDef *port, const uint16_t rowPins[4], const uint16_t colPins[4]) {
+	uint8_t	i;
+
+	simMatrix[id].port = portIndex(port);
+	for (i = 0; i < 4; i++) {
+		simMatrix[id].rowPin[i] = pinIndex(rowPins[i]);
+		simMatrix[id].colPin[i] = pinIndex(colPins[i]);
+	}
+	updatePort(simMatrix[id].port);
+}
+
+/*
+ * Open or close the contact of a key at simNow, and handle the resulting interrupts
+ */
+void simSetContact(uint8_t id, uint8_t key, uint8_t closed) {
+	if (simMatrix[id].contact[key] != closed) {
+		simMatrix[id].contact[key] = closed;
+		updatePort(simMatrix[id].port);
+		simServiceInterrupts();
+	}
+}
+
+/*
+ * Drive a pin from outside the device at simNow: 0 or 1, or SIM_PIN_FREE to release it. Handles the resulting interrupts.
+ */
+void simDrivePin(GPIO_TypeDef *port, uint16_t pin, int8_t level) {
+	uint8_t	p = portIndex(port);
+
+	extLow[p] &= ~pin;
+	extHigh[p] &= ~pin;
+	if (level == 0) {
+		extLow[p] |= pin;
+	} else if (level > 0) {
+		extHigh[p] |= pin;
+	}
+	updatePort(p);
+	simServiceInterrupts();
+}
+
+/*
+ * Date of the next timer tick, end of transfer or RTC alarm, SIM_NEVER when none runs
+ */
+simTime_t simNextEvent(void) {
+	simTime_t	next;
+
+	if (simPower == SIM_STOP) {
+		return rtcAlarmAt;						// all the clocks but the LSI are stopped
+	}
+	if (!(simSysTick.CTRL & SysTick_CTRL_ENABLE_Msk)) {
+		sysTickNext = SIM_NEVER;				// stopped by the firmware
+	} else if (sysTickNext == SIM_NEVER) {
+		sysTickNext = simNow + ((simTime_t) simSysTick.LOAD + 1) * 1000000000ULL / SystemCoreClock;
+	}
+	next = (tim4NextTick < sysTickNext) ? tim4NextTick : sysTickNext;
+	next = (dma4Done < next) ? dma4Done : next;
+	return (rtcAlarmAt < next) ? rtcAlarmAt : next;
+}
+
+/*
+ * Run the timers up to the given date, handling the interrupts at every tick
+ */
+void simAdvance(simTime_t until) {
+	simTime_t	next;
+
+	while ((next = simNextEvent()) <= until) {
+		simNow = next;
+		if (next == tim4NextTick) {
+			tim4NextTick += tim4Period();
+			tim4Tick();
+		}
+		if (next == sysTickNext) {
+			sysTickNext += ((simTime_t) simSysTick.LOAD + 1) * 1000000000ULL / SystemCoreClock;
+			if (simSysTick.CTRL & SysTick_CTRL_TICKINT_Msk) {
+				sysTickPending = 1;
+			}
+		}
+		if (next == dma4Done) {
+			dma4Done = SIM_NEVER;
+			simDMA1_Channel4.CNDTR = 0;
+			simDMA1.ISR |= DMA1_IT_GL4 | DMA1_IT_TC4;
+		}
+		if (next == rtcAlarmAt) {
+			rtcAlarmAt = SIM_NEVER;				// next match once the counter wraps around
+			simRTC.CRL |= RTC_FLAG_ALR;
+			if (simEXTI.RTSR & EXTI_Line17) {
+				simEXTI.PR |= EXTI_Line17;
+			}
+		}
+		simServiceInterrupts();
+	}
+	if (until > simNow) {
+		simNow = until;
+	}
+}
+
+/*
+ * Call the handlers of the pending interrupts, highest priority first, until none is pending. Then let the main loop
+ * run. A handler that does not clear its interrupt is given up after a number of calls at the same date.
+ */
+void simServiceInterrupts(void) {
+	int8_t		irq;
+	uint16_t	calls = 0;
+	uint8_t		asleep = (simPower != SIM_RUN);
+	double		ns;
+
+	if (inHandlers || primask) {
+		return;
+	}
+	inHandlers = 1;
+	while (((irq = pendingIrq()) >= 0) && (calls++ < 1000)) {
+		if (simPower != SIM_RUN) {
+			wakeUp();
+		}
+		if (irq == SIM_IRQ_SYSTICK) {
+			sysTickPending = 0;
+		} else if (irq == SIM_IRQ_PENDSV) {
+			simSCB.ICSR &= ~SCB_ICSR_PENDSVSET;
+		}
+		simStats.irqCount[irq]++;
+		simStats.irqNs[irq] += (simTime_t) simIrqCycles[irq] * 1000000000ULL / SystemCoreClock;
+		if (asleep) {							// otherwise already drawn as run time
+			ns = (double) simIrqCycles[irq] * 1e9 / SystemCoreClock;
+			simEnergy.stateNs[SIM_RUN] += (simTime_t) ns;
+			simEnergy.coreUc += simCurrents.runUaPerMhz * (SystemCoreClock / 1e6) * ns / 1e9;
+			simEnergy.peripheralUc += peripheralUa() * ns / 1e9;
+		}
+		simHandlers[irq]();
+	}
+	inHandlers = 0;
+	if (calls && simOnInterrupt) {
+		simOnInterrupt();
+	}
+}
+
+/* CMSIS core -----------------------------------------------------------------*/
+void NVIC_SetPriority(IRQn_Type IRQn, uint32_t priority) {}
+void NVIC_EnableIRQ(IRQn_Type IRQn) {}
+void NVIC_DisableIRQ(IRQn_Type IRQn) {}
+void NVIC_Init(NVIC_InitTypeDef *NVIC_InitStruct) {}
+void NVIC_PriorityGroupConfig(uint32_t NVIC_PriorityGroup) {}
+
+uint32_t SysTick_Config(uint32_t ticks) {
+	simSysTick.LOAD = ticks - 1;
+	simSysTick.VAL = 0;
+	simSysTick.CTRL = SysTick_CTRL_CLKSOURCE_Msk | SysTick_CTRL_TICKINT_Msk | SysTick_CTRL_ENABLE_Msk;
+	sysTickNext = SIM_NEVER;
+	return 0;
+}
+
+void __disable_irq(void) {
+	primask = 1;
+}
+
+void __enable_irq(void) {
+	primask = 0;
+}
+
+uint32_t __get_PRIMASK(void) {
+	return primask;
+}
+
+void __set_PRIMASK(uint32_t priMask) {
+	primask = priMask;
+}
+
+void __WFI(void) {
+	simEnergyUpdate();
+	simPower = SIM_SLEEP;
+}
+
+/* GPIO -----------------------------------------------------------------------*/
+void GPIO_Init(GPIO_TypeDef *GPIOx, GPIO_InitTypeDef *GPIO_InitStruct) {
+	uint8_t	port = portIndex(GPIOx), pin;
+
+	for (pin = 0; pin < 16; pin++) {
+		if (GPIO_InitStruct->GPIO_Pin & (1 << pin)) {
+			pinMode[port][pin] = GPIO_InitStruct->GPIO_Mode;
+		}
+	}
+	updatePort(port);
+}
+
+uint8_t GPIO_ReadInputDataBit(GPIO_TypeDef *GPIOx, uint16_t GPIO_Pin) {
+	return (GPIOx->IDR & GPIO_Pin) ? 1 : 0;
+}
+
+uint16_t GPIO_ReadInputData(GPIO_TypeDef *GPIOx) {
+	return (uint16_t) GPIOx->IDR;
+}
+
+void GPIO_SetBits(GPIO_TypeDef *GPIOx, uint16_t GPIO_Pin) {
+	GPIOx->ODR |= GPIO_Pin;
+	updatePort(portIndex(GPIOx));
+}
+
+void GPIO_ResetBits(GPIO_TypeDef *GPIOx, uint16_t GPIO_Pin) {
+	GPIOx->ODR &= ~GPIO_Pin;
+	updatePort(portIndex(GPIOx));
+}
+
+void GPIO_EXTILineConfig(uint8_t GPIO_PortSource, uint8_t GPIO_PinSource) {
+	extiPort[GPIO_PinSource & 0x0F] = GPIO_PortSource;
+}
+
+/* RCC ------------------------------------------------------------------------*/
+void RCC_APB2PeriphClockCmd(uint32_t RCC_APB2Periph, FunctionalState NewState) {
+	simEnergyUpdate();
+	rccApb2 = (NewState != DISABLE) ? (rccApb2 | RCC_APB2Periph) : (rccApb2 & ~RCC_APB2Periph);
+}
+
+void RCC_APB1PeriphClockCmd(uint32_t RCC_APB1Periph, FunctionalState NewState) {
+	simEnergyUpdate();
+	rccApb1 = (NewState != DISABLE) ? (rccApb1 | RCC_APB1Periph) : (rccApb1 & ~RCC_APB1Periph);
+}
+
+void RCC_AHBPeriphClockCmd(uint32_t RCC_AHBPeriph, FunctionalState NewState) {
+	simEnergyUpdate();
+	rccAhb = (NewState != DISABLE) ? (rccAhb | RCC_AHBPeriph) : (rccAhb & ~RCC_AHBPeriph);
+}
+
+void RCC_HSICmd(FunctionalState NewState) {}
+void RCC_HSEConfig(uint32_t RCC_HSE) {}
+void RCC_SYSCLKConfig(uint32_t RCC_SYSCLKSource) {}
+void RCC_ADCCLKConfig(uint32_t RCC_PCLK2) {}
+
+FlagStatus RCC_GetFlagStatus(uint8_t RCC_FLAG) {
+	return ((RCC_FLAG == RCC_FLAG_HSIRDY) || (RCC_FLAG == RCC_FLAG_LSIRDY)) ? SET : RESET;
+}
+
+void RCC_LSICmd(FunctionalState NewState) {}
+void RCC_RTCCLKConfig(uint32_t RCC_RTCCLKSource) {}
+
+/*
+ * The RTC counts from the date its clock is enabled
+ */
+void RCC_RTCCLKCmd(FunctionalState NewState) {
+	simEnergyUpdate();
+	rtcBase = rtcCounter();
+	rtcSince = simNow;
+	rtcRunning = (NewState != DISABLE);
+	if (!rtcRunning) {
+		rtcAlarmAt = SIM_NEVER;
+	}
+}
+
+/* EXTI -----------------------------------------------------------------------*/
+void EXTI_Init(EXTI_InitTypeDef *EXTI_InitStruct) {
+	uint32_t	lines = EXTI_InitStruct->EXTI_Line;
+
+	if (EXTI_InitStruct->EXTI_LineCmd == DISABLE) {
+		simEXTI.IMR &= ~lines;
+		return;
+	}
+	simEXTI.RTSR &= ~lines;
+	simEXTI.FTSR &= ~lines;
+	if (EXTI_InitStruct->EXTI_Trigger != EXTI_Trigger_Falling) {
+		simEXTI.RTSR |= lines;
+	}
+	if (EXTI_InitStruct->EXTI_Trigger != EXTI_Trigger_Rising) {
+		simEXTI.FTSR |= lines;
+	}
+	simEXTI.IMR |= lines;
+}
+
+ITStatus EXTI_GetITStatus(uint32_t EXTI_Line) {
+	return (simEXTI.PR & simEXTI.IMR & EXTI_Line) ? SET : RESET;
+}
+
+void EXTI_ClearITPendingBit(uint32_t EXTI_Line) {
+	simEXTI.PR &= ~EXTI_Line;
+	simEXTI.SWIER &= ~EXTI_Line;
+}
+
+/*
+ * Pends the lines that are not masked, as an edge would
+ */
+void EXTI_GenerateSWInterrupt(uint32_t EXTI_Line) {
+	simEXTI.SWIER |= EXTI_Line;
+	simEXTI.PR |= EXTI_Line & simEXTI.IMR;
+}
+
+/* TIM ------------------------------------------------------------------------*/
+void TIM_TimeBaseInit(TIM_TypeDef *TIMx, TIM_TimeBaseInitTypeDef *TIM_TimeBaseInitStruct) {
+	TIMx->PSC = TIM_TimeBaseInitStruct->TIM_Prescaler;
+	TIMx->ARR = TIM_TimeBaseInitStruct->TIM_Period;
+	TIMx->CNT = 0;
+}
+
+void TIM_Cmd(TIM_TypeDef *TIMx, FunctionalState NewState) {
+	if (NewState != DISABLE) {
+		if ((TIMx == TIM4) && !(TIMx->CR1 & TIM_CR1_CEN)) {
+			tim4NextTick = simNow + tim4Period();
+		}
+		TIMx->CR1 |= TIM_CR1_CEN;
+	} else {
+		if (TIMx == TIM4) {
+			tim4NextTick = SIM_NEVER;
+		}
+		TIMx->CR1 &= ~TIM_CR1_CEN;
+	}
+}
+
+void TIM_ITConfig(TIM_TypeDef *TIMx, uint16_t TIM_IT, FunctionalState NewState) {
+	if (NewState != DISABLE) {
+		TIMx->DIER |= TIM_IT;
+	} else {
+		TIMx->DIER &= ~TIM_IT;
+	}
+}
+
+ITStatus TIM_GetITStatus(TIM_TypeDef *TIMx, uint16_t TIM_IT) {
+	return (TIMx->SR & TIMx->DIER & TIM_IT) ? SET : RESET;
+}
+
+void TIM_ClearITPendingBit(TIM_TypeDef *TIMx, uint16_t TIM_IT) {
+	TIMx->SR &= ~TIM_IT;
+}
+
+void TIM_SetCounter(TIM_TypeDef *TIMx, uint16_t Counter) {
+	TIMx->CNT = Counter;
+}
+
+uint16_t TIM_GetCounter(TIM_TypeDef *TIMx) {
+	return TIMx->CNT;
+}
+
+void TIM_SetCompare1(TIM_TypeDef *TIMx, uint16_t Compare1) { TIMx->CCR1 = Compare1; }
+void TIM_SetCompare2(TIM_TypeDef *TIMx, uint16_t Compare2) { TIMx->CCR2 = Compare2; }
+void TIM_SetCompare3(TIM_TypeDef *TIMx, uint16_t Compare3) { TIMx->CCR3 = Compare3; }
+void TIM_SetCompare4(TIM_TypeDef *TIMx, uint16_t Compare4) { TIMx->CCR4 = Compare4; }
+void TIM_SelectOutputTrigger(TIM_TypeDef *TIMx, uint16_t TIM_TRGOSource) {}
+
+/* PWR, USART, DMA ------------------------------------------------------------*/
+void PWR_EnterSTOPMode(uint32_t PWR_Regulator, uint8_t PWR_STOPEntry) {
+	simEnergyUpdate();
+	simPower = SIM_STOP;
+	stopSince = simNow;
+	simEnergy.stopEntries++;
+}
+
+void PWR_BackupAccessCmd(FunctionalState NewState) {}
+
+void RTC_WaitForSynchro(void) {}
+void RTC_WaitForLastTask(void) {}
+
+void RTC_SetPrescaler(uint32_t PrescalerValue) {
+	rtcBase = rtcCounter();
+	rtcSince = simNow;
+	rtcPrescaler = PrescalerValue & 0xFFFFF;
+	RTC_SetAlarm(((uint32_t) simRTC.ALRH << 16) | simRTC.ALRL);
+}
+
+uint32_t RTC_GetCounter(void) {
+	return rtcCounter();
+}
+
+/*
+ * The alarm goes off when the counter reaches the value, i.e. at the start of that counter period
+ */
+void RTC_SetAlarm(uint32_t AlarmValue) {
+	uint32_t	now = rtcCounter();
+
+	simRTC.ALRH = AlarmValue >> 16;
+	simRTC.ALRL = AlarmValue & 0xFFFF;
+	if (!rtcRunning || (AlarmValue <= now)) {
+		rtcAlarmAt = SIM_NEVER;
+	} else {
+		rtcAlarmAt = rtcSince + (simTime_t) (AlarmValue - rtcBase) * rtcTickNs();
+	}
+}
+
+void RTC_ClearFlag(uint16_t RTC_FLAG) {
+	simRTC.CRL &= ~RTC_FLAG;
+}
+
+void USART_Init(USART_TypeDef *USARTx, USART_InitTypeDef *USART_InitStruct) {
+	usartBaud = USART_InitStruct->USART_BaudRate;
+}
+
+void USART_Cmd(USART_TypeDef *USARTx, FunctionalState NewState) {}
+void USART_DMACmd(USART_TypeDef *USARTx, uint16_t USART_DMAReq, FunctionalState NewState) {}
+
+/*
+ * The last byte leaves the shift register when the DMA transfer ends
+ */
+FlagStatus USART_GetFlagStatus(USART_TypeDef *USARTx, uint16_t USART_FLAG) {
+	return (dma4Done == SIM_NEVER) ? SET : RESET;
+}
+
+void DMA_DeInit(DMA_Channel_TypeDef *DMAy_Channelx) {
+	memset(DMAy_Channelx, 0, sizeof *DMAy_Channelx);
+}
+
+void DMA_Init(DMA_Channel_TypeDef *DMAy_Channelx, DMA_InitTypeDef *DMA_InitStruct) {
+	DMAy_Channelx->CNDTR = DMA_InitStruct->DMA_BufferSize;
+}
+
+/*
+ * Enabling channel 4 starts sending CNDTR bytes to USART1
+ */
+void DMA_Cmd(DMA_Channel_TypeDef *DMAy_Channelx, FunctionalState NewState) {
+	if (NewState == DISABLE) {
+		DMAy_Channelx->CCR &= ~SIM_DMA_CCR_EN;
+		if (DMAy_Channelx == DMA1_Channel4) {
+			dma4Done = SIM_NEVER;
+		}
+		return;
+	}
+	if ((DMAy_Channelx == DMA1_Channel4) && !(DMAy_Channelx->CCR & SIM_DMA_CCR_EN) && DMAy_Channelx->CNDTR && usartBaud) {
+		dma4Done = simNow + (simTime_t) DMAy_Channelx->CNDTR * 10 * 1000000000ULL / usartBaud;
+	}
+	DMAy_Channelx->CCR |= SIM_DMA_CCR_EN;
+}
+
+void DMA_ITConfig(DMA_Channel_TypeDef *DMAy_Channelx, uint32_t DMA_IT, FunctionalState NewState) {
+	if (NewState != DISABLE) {
+		DMAy_Channelx->CCR |= DMA_IT;
+	} else {
+		DMAy_Channelx->CCR &= ~DMA_IT;
+	}
+}
+
+void DMA_SetCurrDataCounter(DMA_Channel_TypeDef *DMAy_Channelx, uint16_t DataNumber) {
+	DMAy_Channelx->CNDTR = DataNumber;
+}
+
+ITStatus DMA_GetITStatus(uint32_t DMAy_IT) {
+	return (simDMA1.ISR & DMAy_IT) ? SET : RESET;
+}
+
+/*
+ * Clearing the global flag of a channel clears all its flags
+ */
+void DMA_ClearITPendingBit(uint32_t DMAy_IT) {
+	uint8_t	channel;
+
+	for (channel = 0; channel < 7; channel++) {
+		if (DMAy_IT & (DMA1_IT_GL1 << (4 * channel))) {
+			DMAy_IT |= 0x0FUL << (4 * channel);
+		}
+	}
+	simDMA1.ISR &= ~DMAy_IT;
+}
+
+/* Energy ---------------------------------------------------------------------*/
+static const struct {
+	const char	*name;
+	double		*value;
+} currentNames[] = {
+	{"run_ua_mhz", &simCurrents.runUaPerMhz},	{"sleep_ua_mhz", &simCurrents.sleepUaPerMhz},
+	{"stop_ua", &simCurrents.stopUa},			{"stop_wake_us", &simCurrents.stopWakeUs},
+	{"rtc_ua", &simCurrents.rtcUa},
+	{"battery_mah", &simCurrents.batteryMah},
+	{"tim3", &simCurrents.apb1UaPerMhz[1]},		{"tim4", &simCurrents.apb1UaPerMhz[2]},
+	{"pwr", &simCurrents.apb1UaPerMhz[28]},		{"afio", &simCurrents.apb2UaPerMhz[0]},
+	{"gpioa", &simCurrents.apb2UaPerMhz[2]},	{"gpiob", &simCurrents.apb2UaPerMhz[3]},
+	{"gpioc", &simCurrents.apb2UaPerMhz[4]},	{"gpiod", &simCurrents.apb2UaPerMhz[5]},
+	{"adc1", &simCurrents.apb2UaPerMhz[9]},		{"usart1", &simCurrents.apb2UaPerMhz[14]},
+	{"dma1", &simCurrents.ahbUaPerMhz[0]},
+};
+
+/*
+ * Read a current table: one "name value" per line, '#' starts a comment. The names are those of currentNames, the
+ * peripherals in uA/MHz. Returns 0, or -1 if the file cannot be read or has an unknown name.
+ */
+int simLoadCurrents(const char *path) {
+	FILE		*f = fopen(path, "r");
+	char		line[128], name[32];
+	double		value;
+	unsigned	i;
+
+	if (f == NULL) {
+		return -1;
+	}
+	while (fgets(line, sizeof line, f)) {
+		if (sscanf(line, " %31[^# \t\n] %lf", name, &value) != 2) {
+			continue;							// blank line or comment
+		}
+		for (i = 0; i < sizeof currentNames / sizeof currentNames[0]; i++) {
+			if (!strcmp(name, currentNames[i].name)) {
+				*currentNames[i].value = value;
+				break;
+			}
+		}
+		if (i == sizeof currentNames / sizeof currentNames[0]) {
+			fclose(f);
+			return -1;
+		}
+	}
+	fclose(f);
+	return 0;
+}
+
+/*
+ * Draw the charge of the current power state up to simNow. Called before every change of state or clocks.
+ */
+void simEnergyUpdate(void) {
+	double	s = (double) (simNow - powerSince) / 1e9, mhz = SystemCoreClock / 1e6;
+
+	simEnergy.stateNs[simPower] += simNow - powerSince;
+	switch (simPower) {
+		case SIM_RUN:
+			simEnergy.coreUc += simCurrents.runUaPerMhz * mhz * s;
+			simEnergy.peripheralUc += peripheralUa() * s;
+			break;
+		case SIM_SLEEP:
+			simEnergy.coreUc += simCurrents.sleepUaPerMhz * mhz * s;
+			simEnergy.peripheralUc += peripheralUa() * s;
+			break;
+		default:
+			simEnergy.coreUc += simCurrents.stopUa * s;
+			break;
+	}
+	if (rtcRunning) {
+		simEnergy.peripheralUc += simCurrents.rtcUa * s;
+	}
+	powerSince = simNow;
+}
+
+/*
+ * Average current since simReset()
+ */
+double simAverageUa(void) {
+	simEnergyUpdate();
+	return simNow ? (simEnergy.coreUc + simEnergy.peripheralUc) / ((double) simNow / 1e9) : 0.0;
+}
+
+/*
+ * Battery life at the average current since simReset()
+ */
+double simBatteryDays(void) {
+	double	ua = simAverageUa();
+
+	return ua > 0 ? simCurrents.batteryMah * 1000.0 / ua / 24.0 : 0.0;
+}
+
+/*
+ * An interrupt wakes the core up. Out of STOP mode, the timers count again from where they were stopped.
+ */
+static void wakeUp(void) {
+	simEnergyUpdate();
+	if (simPower == SIM_STOP) {
+		if (tim4NextTick != SIM_NEVER) {
+			tim4NextTick += simNow - stopSince;
+		}
+		if (sysTickNext != SIM_NEVER) {
+			sysTickNext += simNow - stopSince;
+		}
+		if (dma4Done != SIM_NEVER) {
+			dma4Done += simNow - stopSince;
+		}
+		simEnergy.coreUc += simCurrents.runUaPerMhz * (SystemCoreClock / 1e6) * simCurrents.stopWakeUs / 1e6;
+	}
+	simPower = SIM_RUN;
+}
+
+/*
+ * Current of the peripheral clocks enabled
+ */
+static double peripheralUa(void) {
+	double	ua = 0;
+	uint8_t	bit;
+
+	for (bit = 0; bit < 32; bit++) {
+		if (rccApb1 & (1UL << bit))	ua += simCurrents.apb1UaPerMhz[bit];
+		if (rccApb2 & (1UL << bit))	ua += simCurrents.apb2UaPerMhz[bit];
+		if (rccAhb & (1UL << bit))	ua += simCurrents.ahbUaPerMhz[bit];
+	}
+	return ua * SystemCoreClock / 1e6;
+}
+
+/* Models ---------------------------------------------------------------------*/
+static uint8_t portIndex(GPIO_TypeDef *GPIOx) {
+	return (uint8_t) (GPIOx - simGPIO);
+}
+
+static uint8_t pinIndex(uint16_t pin) {
+	return (uint8_t) (31 - __CLZ(pin));
+}
+
+static uint8_t findNet(uint8_t *net, uint8_t pin) {
+	while (net[pin] != pin) {
+		pin = net[pin];
+	}
+	return pin;
+}
+
+/*
+ * Compute the input levels of a port from the pin modes, the outputs and the closed key contacts, and set the EXTI
+ * pending bits of the lines that see an edge
+ */
+static void updatePort(uint8_t port) {
+	uint8_t		net[16], pin, m, key, a, b;
+	uint16_t	low = 0, high = 0, pullUp = 0, pullDown = 0, analog = 0;
+	uint16_t	netLow = 0, netHigh = 0, netUp = 0, netDown = 0, netExtLow = 0, netExtHigh = 0;
+	uint16_t	idr = 0, changed, rising, falling, lines;
+	uint32_t	odr = simGPIO[port].ODR;
+
+	for (pin = 0; pin < 16; pin++) {
+		net[pin] = pin;
+		switch (pinMode[port][pin]) {
+			case GPIO_Mode_Out_PP:
+			case GPIO_Mode_AF_PP:
+				if (odr & (1 << pin)) high |= 1 << pin; else low |= 1 << pin;
+				break;
+			case GPIO_Mode_Out_OD:
+			case GPIO_Mode_AF_OD:
+				if (!(odr & (1 << pin))) low |= 1 << pin;
+				break;
+			case GPIO_Mode_IPU:			pullUp |= 1 << pin;		break;
+			case GPIO_Mode_IPD:			pullDown |= 1 << pin;	break;
+			case GPIO_Mode_AIN:			analog |= 1 << pin;		break;
+			default:											break;
+		}
+	}
+
+	for (m = 0; m < SIM_MAX_MATRIX; m++) {						// a closed contact joins its row and column nets
+		if (simMatrix[m].port != port) {
+			continue;
+		}
+		for (key = 0; key < 16; key++) {
+			if (simMatrix[m].contact[key]) {
+				a = findNet(net, simMatrix[m].rowPin[key / 4]);
+				b = findNet(net, simMatrix[m].colPin[key % 4]);
+				net[a] = b;
+			}
+		}
+	}
+
+	for (pin = 0; pin < 16; pin++) {
+		m = findNet(net, pin);
+		if (low & (1 << pin))		netLow |= 1 << m;
+		if (high & (1 << pin))		netHigh |= 1 << m;
+		if (pullUp & (1 << pin))	netUp |= 1 << m;
+		if (pullDown & (1 << pin))	netDown |= 1 << m;
+		if (extLow[port] & (1 << pin))	netExtLow |= 1 << m;
+		if (extHigh[port] & (1 << pin))	netExtHigh |= 1 << m;
+	}
+	for (pin = 0; pin < 16; pin++) {							// external, driven low, driven high, pulled up, pulled down
+		m = findNet(net, pin);
+		if (netExtLow & (1 << m)) {
+			continue;
+		}
+		if ((netExtHigh & (1 << m)) ||
+			(!(netLow & (1 << m)) && ((netHigh & (1 << m)) || (netUp & (1 << m)) || !(netDown & (1 << m))))) {
+			idr |= 1 << pin;
+		}
+	}
+	idr &= ~analog;
+
+	changed = idr ^ (uint16_t) simGPIO[port].IDR;
+	simGPIO[port].IDR = idr;
+
+	lines = 0;
+	for (pin = 0; pin < 16; pin++) {
+		if (extiPort[pin] == port) {
+			lines |= 1 << pin;
+		}
+	}
+	rising = changed & idr & lines & simEXTI.RTSR;
+	falling = changed & ~idr & lines & simEXTI.FTSR;
+	simEXTI.PR |= rising | falling;
+	simStats.edges += __builtin_popcount((rising | falling) & simEXTI.IMR);
+}
+
+/*
+ * Period of the RTC counter, and its value at simNow
+ */
+static simTime_t rtcTickNs(void) {
+	return ((simTime_t) rtcPrescaler + 1) * 1000000000ULL / SIM_LSI_HZ;
+}
+
+static uint32_t rtcCounter(void) {
+	return rtcRunning ? rtcBase + (uint32_t) ((simNow - rtcSince) / rtcTickNs()) : rtcBase;
+}
+
+static simTime_t tim4Period(void) {
+	return ((simTime_t) simTIM4.PSC + 1) * 1000000000ULL / SystemCoreClock;
+}
+
+/*
+ * One count of TIM4: compare match flags, and update flag when the counter wraps
+ */
+static void tim4Tick(void) {
+	if (simTIM4.CNT >= simTIM4.ARR) {
+		simTIM4.CNT = 0;
+		simTIM4.SR |= TIM_IT_Update;
+	} else {
+		simTIM4.CNT++;
+	}
+	if (simTIM4.CNT == simTIM4.CCR1)	simTIM4.SR |= TIM_IT_CC1;
+	if (simTIM4.CNT == simTIM4.CCR2)	simTIM4.SR |= TIM_IT_CC2;
+	if (simTIM4.CNT == simTIM4.CCR3)	simTIM4.SR |= TIM_IT_CC3;
+	if (simTIM4.CNT == simTIM4.CCR4)	simTIM4.SR |= TIM_IT_CC4;
+}
+
+/*
+ * Highest priority interrupt pending and enabled, or -1
+ */
+static int8_t pendingIrq(void) {
+	if (simTIM4.SR & simTIM4.DIER & (TIM_IT_CC1 | TIM_IT_CC2 | TIM_IT_CC3 | TIM_IT_CC4 | TIM_IT_Update)) {
+		return SIM_IRQ_TIM4;
+	}
+	if ((simDMA1.ISR & DMA1_IT_TC4) && (simDMA1_Channel4.CCR & DMA_IT_TC)) {
+		return SIM_IRQ_DMA1_CH4;
+	}
+	if (simEXTI.PR & simEXTI.IMR & 0x03E0) {
+		return SIM_IRQ_EXTI9_5;
+	}
+	if (simEXTI.PR & simEXTI.IMR & 0xFC00) {
+		return SIM_IRQ_EXTI15_10;
+	}
+	if (simEXTI.PR & simEXTI.IMR & EXTI_Line17) {
+		return SIM_IRQ_RTC_ALARM;
+	}
+	if (sysTickPending) {
+		return SIM_IRQ_SYSTICK;
+	}
+	if (simSCB.ICSR & SCB_ICSR_PENDSVSET) {
+		return SIM_IRQ_PENDSV;
+	}
+	return -1;
+}
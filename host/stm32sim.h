@@ -0,0 +1,79 @@
+/*
+ * stm32sim.h
+ *
+ *  Author: Ahmed Talaat (aa_talaat@yahoo.com)
+ */
+
+#ifndef STM32SIM_H_
+#define STM32SIM_H_
+
+#include "stm32f10x.h"
+
+typedef uint64_t	simTime_t;					// ns since simReset()
+
+#define SIM_NEVER		((simTime_t) -1)
+#define SIM_US			((simTime_t) 1000)
+#define SIM_MS			((simTime_t) 1000000)
+
+#define SIM_MAX_MATRIX	4
+
+#define SIM_PIN_FREE	(-1)					// simDrivePin level: no external drive
+
+/*
+ * Interrupt handlers run by the simulator, in decreasing priority order as configured by the firmware
+ */
+typedef enum { SIM_IRQ_TIM4, SIM_IRQ_DMA1_CH4, SIM_IRQ_EXTI9_5, SIM_IRQ_EXTI15_10, SIM_IRQ_RTC_ALARM, SIM_IRQ_SYSTICK,
+			   SIM_IRQ_PENDSV, SIM_IRQ_COUNT } simIrq_t;
+
+typedef enum { SIM_RUN, SIM_SLEEP, SIM_STOP, SIM_POWER_COUNT } simPower_t;
+
+/*
+ * Current drawn by the device, in uA. The defaults are typical values of the STM32F100 datasheet (3.3 V, 25 C), to be
+ * calibrated against the measurements of the board with a table file (simLoadCurrents).
+ */
+typedef struct simCurrents_s {
+	double		runUaPerMhz;				// core running from flash, all the peripheral clocks off
+	double		sleepUaPerMhz;				// WFI sleep, all the peripheral clocks off
+	double		stopUa;						// STOP mode with the low-power regulator, everything included
+	double		stopWakeUs;					// STOP wake-up time, drawn at run current
+	double		rtcUa;						// LSI and RTC, in every state once the RTC clock is enabled
+	double		apb1UaPerMhz[32];			// added in run and sleep while the clock of a RCC_APB1Periph_xxx bit is on
+	double		apb2UaPerMhz[32];			// same for RCC_APB2Periph_xxx
+	double		ahbUaPerMhz[32];			// same for RCC_AHBPeriph_xxx
+	double		batteryMah;					// capacity used for the battery life
+} simCurrents_t;
+
+typedef struct simEnergy_s {
+	simTime_t	stateNs[SIM_POWER_COUNT];	// time spent in each power state
+	double		coreUc;						// charge drawn by the core and the regulator, in uC (uA.s)
+	double		peripheralUc;				// charge drawn by the peripheral clocks
+	uint32_t	stopEntries;
+} simEnergy_t;
+
+typedef struct simStats_s {
+	uint32_t	irqCount[SIM_IRQ_COUNT];		// handler calls
+	simTime_t	irqNs[SIM_IRQ_COUNT];			// CPU time spent in the handlers, from simIrqCycles
+	uint32_t	edges;							// EXTI edges detected on the enabled lines
+} simStats_t;
+
+extern simTime_t	simNow;
+extern simStats_t	simStats;
+extern uint32_t		simIrqCycles[SIM_IRQ_COUNT];	// cost of one call of each handler, in CPU cycles
+extern void			(*simOnInterrupt)(void);		// called after the handlers, like the main loop woken up
+extern simPower_t	simPower;						// set by __WFI and PWR_EnterSTOPMode, back to SIM_RUN by an interrupt
+extern simCurrents_t	simCurrents;
+extern simEnergy_t	simEnergy;
+
+void simReset(void);
+void simAttachMatrix(uint8_t id, GPIO_TypeDef *port, const uint16_t rowPins[4], const uint16_t colPins[4]);
+void simSetContact(uint8_t id, uint8_t key, uint8_t closed);
+void simDrivePin(GPIO_TypeDef *port, uint16_t pin, int8_t level);
+simTime_t simNextEvent(void);
+void simAdvance(simTime_t until);
+void simServiceInterrupts(void);
+int simLoadCurrents(const char *path);
+void simEnergyUpdate(void);
+double simAverageUa(void);
+double simBatteryDays(void);
+
+#endif /* STM32SIM_H_ */
@@ -0,0 +1,222 @@
+/*
+ * terminal.c
+ *
+ *  Author: Ahmed Talaat (aa_talaat@yahoo.com)
+ *
+ * One terminal of the fleet simulator (fleet.c): the keypad firmware over the peripheral models of stm32sim.c, with
+ * main() modelled by firmware.c as in keysim.c, played with the usage of a terminalProfile_t for hours of simulated time.
+ *
+ * The contact events are generated one press at a time rather than for the whole run, so a day of traffic takes no
+ * memory, and the time in STOP mode between the sessions costs nothing to simulate. A decoded key is matched with the
+ * press being played: the press window runs from its first edge to the first edge of the next press, the gap between
+ * them being longer than the debounce delay.
+ *
+ * The random numbers come from a generator of this file seeded by the profile, not from rand(): a terminal gives the
+ * same result whatever the thread and the other terminals run by the same copy of the library.
+ *
+ * Built with the firmware into a shared library (make fleet), which fleet.c loads once per worker thread.
+ */
+#include <string.h>
+#include <math.h>
+
+#include "stm32f10x.h"
+#include "stm32sim.h"
+#include "queues.h"
+#include "buttons.h"
+#include "keymap.h"
+#include "firmware.h"
+#include "terminal.h"
+
+#define BOUNCE_GAP_MS		1.5					// longest quiet time of a bouncing contact
+#define MAX_PRESS_EVENTS	1024				// contact events of one press, chatter included
+#define HOUR_NS				(3600.0 * SIM_MS * 1000)
+#define DAY_NS				(24 * HOUR_NS)
+
+typedef struct contactEvent_s {
+	simTime_t	t;
+	uint8_t		closed;
+} contactEvent_t;
+
+static terminalResult_t	*result;
+static uint64_t			rng;
+static contactEvent_t	events[MAX_PRESS_EVENTS];
+static uint16_t			nEvents;
+static uint8_t			wornKeys[16];
+static uint8_t			pressKey;				// expected ASCII code of the press being played, 0 before the first one
+static simTime_t		pressStart;
+static uint8_t			pressMatched;
+
+/*
+ * xorshift64*, uniform in [0, 1)
+ */
+static double random01(void) {
+	rng ^= rng >> 12;
+	rng ^= rng << 25;
+	rng ^= rng >> 27;
+	return (double) ((rng * 0x2545F4914F6CDD1DULL) >> 11) / 9007199254740992.0;
+}
+
+static double uniform(double lo, double hi) {
+	return lo + (hi - lo) * random01();
+}
+
+/*
+ * Closes the window of the current press
+ */
+static void closePress(void) {
+	if (pressKey != 0 && !pressMatched) {
+		result->missed++;
+	}
+	pressKey = 0;
+}
+
+static void keyDecoded(uint8_t key) {
+	double	latency = (double) (simNow - pressStart) / SIM_MS;
+	uint8_t	bin = (latency < TERMINAL_LATENCY_BINS - 1) ? (uint8_t) latency : TERMINAL_LATENCY_BINS - 1;
+
+	if (pressKey == 0 || key != pressKey || pressMatched) {
+		result->phantom++;
+		return;
+	}
+	pressMatched = 1;
+	result->decoded++;
+	result->latency[bin]++;
+	result->latencySumMs += latency;
+	if (latency > result->latencyMaxMs) {
+		result->latencyMaxMs = latency;
+	}
+}
+
+/*
+ * Messages of the firmware main loop
+ */
+static void observe(msgQueueDef *msg) {
+	switch (msg->msgID) {
+		case MSG_BT_DOWN:
+			keyDecoded(msg->msgContent);
+			break;
+		case MSG_KEY_CHATTER:
+			result->chatterEvents++;
+			break;
+		case MSG_LINE_FAULT:
+			result->faultEvents++;
+			break;
+		default:
+			break;
+	}
+}
+
+static void addEvent(simTime_t t, uint8_t closed) {
+	if (nEvents < MAX_PRESS_EVENTS) {
+		events[nEvents].t = t;
+		events[nEvents].closed = closed;
+		nEvents++;
+	}
+}
+
+/*
+ * Contact toggling from t0 for bounceMs, ending in the given state. Returns the date of the last edge.
+ */
+static simTime_t bounce(simTime_t t0, double bounceMs, uint8_t closed) {
+	simTime_t	end = t0 + (simTime_t) (bounceMs * SIM_MS), t = t0;
+	uint8_t		state = closed;
+
+	addEvent(t, state);
+	while (1) {
+		t += (simTime_t) (uniform(0.05, BOUNCE_GAP_MS) * SIM_MS);
+		if (t >= end) {
+			break;
+		}
+		state = !state;
+		addEvent(t, state);
+	}
+	if (state != closed) {
+		addEvent(end, closed);
+		return end;
+	}
+	return events[nEvents - 1].t;
+}
+
+/*
+ * Plays one press of a key from t, up to the end of its release bounce. Returns that date.
+ */
+static simTime_t press(simTime_t t, uint8_t key, uint8_t chatterPercent) {
+	simTime_t	holdEnd, glitch;
+	uint16_t	i;
+	double		bounceMs = wornKeys[key] ? uniform(8, 15) : uniform(1.5, 3);
+
+	simAdvance(t);
+	closePress();
+	pressKey = keypads[0].keyMap[key];
+	pressStart = t;
+	pressMatched = 0;
+	result->presses++;
+
+	nEvents = 0;
+	t = bounce(t, bounceMs, 1);
+	holdEnd = t + (simTime_t) (uniform(60, 250) * SIM_MS);
+	if (uniform(0, 100) < chatterPercent) {
+		for (glitch = t + 20 * SIM_MS; glitch + 10 * SIM_MS < holdEnd; glitch += (simTime_t) (uniform(15, 40) * SIM_MS)) {
+			glitch = bounce(glitch, uniform(0.3, 3), 0);
+			bounce(glitch + (simTime_t) (uniform(0.2, 0.6) * SIM_MS), uniform(0.3, 1.5), 1);
+		}
+	}
+	t = bounce(holdEnd, wornKeys[key] ? uniform(8, 15) : uniform(1.5, 3), 0);
+
+	for (i = 0; i < nEvents; i++) {
+		simAdvance(events[i].t);
+		simSetContact(0, key, events[i].closed);
+	}
+	return t;
+}
+
+/*
+ * Date of the next session after t: exponential gaps during the active hours of each day
+ */
+static simTime_t nextSession(simTime_t t, const terminalProfile_t *profile) {
+	double	meanNs = HOUR_NS / profile->sessionsPerHour, day;
+
+	t += (simTime_t) (-meanNs * log(1.0 - random01()));
+	day = floor(t / DAY_NS);
+	if (t - day * DAY_NS >= profile->activeHours * HOUR_NS) {
+		t = (simTime_t) ((day + 1) * DAY_NS) + (simTime_t) (-meanNs * log(1.0 - random01()));
+	}
+	return t;
+}
+
+void Terminal_Run(const terminalProfile_t *profile, terminalResult_t *res) {
+	simTime_t	end = (simTime_t) (profile->hours * HOUR_NS), t;
+	uint8_t		key, keys, i;
+
+	memset(res, 0, sizeof *res);
+	result = res;
+	rng = profile->seed * 0x9E3779B97F4A7C15ULL + 0x2545F4914F6CDD1DULL;
+	if (rng == 0) {
+		rng = 1;
+	}
+	pressKey = 0;
+
+	firmwareObserver = observe;
+	Firmware_Start();
+	for (key = 0; key < 16; key++) {
+		wornKeys[key] = uniform(0, 100) < profile->wornPercent;
+	}
+
+	for (t = nextSession(0, profile); t < end; t = nextSession(t, profile)) {
+		keys = profile->keysPerSession + (uint8_t) uniform(0, profile->keysPerSession + 1);
+		for (i = 0; i < keys; i++) {
+			t = press(t, (uint8_t) uniform(0, 16), profile->chatterPercent);
+			t += (simTime_t) (uniform(150, 600) * SIM_MS);
+		}
+	}
+	simAdvance(end > simNow ? end : simNow + 100 * SIM_MS);
+	closePress();
+
+	res->averageUa = simAverageUa();
+	res->chargeUc = simEnergy.coreUc + simEnergy.peripheralUc;
+	res->simulatedS = (double) simNow / 1e9;
+	res->stopEntries = simEnergy.stopEntries;
+	for (i = 0; i < SIM_IRQ_COUNT; i++) {
+		res->irqs += simStats.irqCount[i];
+	}
+}
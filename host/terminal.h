@@ -0,0 +1,53 @@
+/*
+ * terminal.h
+ *
+ *  Author: Ahmed Talaat (aa_talaat@yahoo.com)
+ */
+
+#ifndef TERMINAL_H_
+#define TERMINAL_H_
+
+#include <stdint.h>
+
+#define TERMINAL_LATENCY_BINS	64				// 1 ms bins of the press to decode latency, the last one holds the rest
+
+/*
+ * Usage of one terminal over the simulated time: sessions (a PIN, an amount...) arrive at random during the active
+ * hours, each a burst of keys typed at 150 to 600 ms
+ */
+typedef struct terminalProfile_s {
+	uint64_t	seed;
+	double		hours;							// simulated time
+	double		activeHours;					// the sessions fall in the first activeHours of every day
+	double		sessionsPerHour;				// during the active hours
+	uint8_t		keysPerSession;					// 1 to 2 times this number of keys per session
+	uint8_t		wornPercent;					// share of the 16 keys that bounce 8 to 15 ms instead of 1.5 to 3 ms
+	uint8_t		chatterPercent;					// share of the holds with bursts of contact loss
+} terminalProfile_t;
+
+typedef struct terminalResult_s {
+	uint32_t	presses;
+	uint32_t	decoded;						// presses decoded once, with their key
+	uint32_t	missed;							// presses never decoded: the drops
+	uint32_t	phantom;						// keys decoded with no press, a wrong key, or twice
+	uint32_t	chatterEvents;					// MSG_KEY_CHATTER
+	uint32_t	faultEvents;					// MSG_LINE_FAULT
+	uint32_t	latency[TERMINAL_LATENCY_BINS];	// decoded presses per latency bin
+	double		latencySumMs;
+	double		latencyMaxMs;
+	double		simulatedS;
+	double		chargeUc;						// core and peripheral charge
+	double		averageUa;
+	uint32_t	stopEntries;
+	uint64_t	irqs;							// handler calls
+} terminalResult_t;
+
+/*
+ * Runs one terminal from reset: the firmware globals are those of the calling copy of the library, so one copy runs
+ * one terminal at a time
+ */
+typedef void (*terminalRun_t)(const terminalProfile_t *profile, terminalResult_t *result);
+
+void Terminal_Run(const terminalProfile_t *profile, terminalResult_t *result);
+
+#endif /* TERMINAL_H_ */
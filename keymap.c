@@ -0,0 +1,161 @@
+/*
+ * keymap.c
+ *
+ *  Author: Ahmed Talaat (aa_talaat@yahoo.com)
+ *
+ * Layered keymaps. Each keypad has a stack of layer tables in flash, indexed by the key matrix index (4*row+col).
+ * Layer 0 is always active, the other ones are switched on by the application (Keymap_SetToggled) or by layer keys:
+ *	- KM_MO(n) keeps layer n active while the key is held.
+ *	- KM_TG(n) switches layer n on or off at each press.
+ * For each key, the highest active layer that is not KM_TRANS gives the code.
+ *
+ * The layers are resolved into the keymap_t keyMap[16] table every time the active layers change, in the main loop.
+ * The ISRs keep reading a single table indexed by the matrix index, so getKeyPressed() costs exactly the same as with
+ * a fixed map whatever the number of layers. The table is updated one byte at a time: a key decoded while the layers are
+ * being switched gets either its old or its new code.
+ */
+
+#include "stm32f10x.h"
+#include "keymap.h"
+#include "dispatch.h"
+
+keymap_t	keymaps[NUM_KEYPADS];
+
+/*
+ * Default layers:
+ *	- BASE: numeric keypad, the D key is the FN key.
+ *	- HEX: * and # become E and F.
+ *	- CALC: calculator layout (7 8 9 on the top row) instead of the phone one.
+ *	- FN: held with the D key. FN+1 toggles HEX, FN+2 toggles CALC, FN+3 sends D.
+ * The FN combinations must be on another column than the FN key: its column stays low while FN is held, so a second
+ * key on it gives no EXTI edge. They are also on a row above FN, as the scan returns the first low row.
+ */
+const uint8_t defaultLayers[DEFAULT_LAYERS][16] = {
+	{	'1', '2', '3', 'A',
+		'4', '5', '6', 'B',
+		'7', '8', '9', 'C',
+		'*', '0', '#', KM_MO(LAYER_FN)	},
+
+	{	KM_TRANS, KM_TRANS, KM_TRANS, KM_TRANS,
+		KM_TRANS, KM_TRANS, KM_TRANS, KM_TRANS,
+		KM_TRANS, KM_TRANS, KM_TRANS, KM_TRANS,
+		'E',      KM_TRANS, 'F',      KM_TRANS	},
+
+	{	'7',      '8',      '9',      KM_TRANS,
+		KM_TRANS, KM_TRANS, KM_TRANS, KM_TRANS,
+		'1',      '2',      '3',      KM_TRANS,
+		KM_TRANS, KM_TRANS, KM_TRANS, KM_TRANS	},
+
+	{	KM_TG(LAYER_HEX), KM_TG(LAYER_CALC), 'D', KM_TRANS,
+		KM_TRANS, KM_TRANS, KM_TRANS, KM_TRANS,
+		KM_TRANS, KM_TRANS, KM_TRANS, KM_TRANS,
+		KM_TRANS, KM_TRANS, KM_TRANS, KM_TRANS	}
+};
+
+static void resolveKeymap(keymap_t *keymap);
+
+/*
+ * Give every keypad the default layers, with only the base layer active
+ */
+void Keymap_Init(void) {
+	uint8_t	id;
+
+	for (id = 0; id < NUM_KEYPADS; id++) {
+		Keymap_SelectLayers(&keymaps[id], defaultLayers, DEFAULT_LAYERS);
+	}
+}
+
+/*
+ * Switch a keypad to another stack of layers (per customer layouts), with only its base layer active
+ */
+void Keymap_SelectLayers(keymap_t *keymap, const uint8_t (*layers)[16], uint8_t nLayers) {
+	uint8_t	i;
+
+	keymap->layers = layers;
+	keymap->nLayers = (nLayers > KEYMAP_MAX_LAYERS) ? KEYMAP_MAX_LAYERS : nLayers;
+	keymap->toggled = 0;
+	keymap->momentary = 0;
+	for (i = 0; i < 4; i++) {
+		keymap->momentaryCol[i] = 0;
+	}
+	resolveKeymap(keymap);
+}
+
+/*
+ * Select the toggled layers from the application, e.g. numeric versus hex mode
+ */
+void Keymap_SetToggled(keymap_t *keymap, uint8_t layerMask) {
+	keymap->toggled = layerMask;
+	resolveKeymap(keymap);
+}
+
+/*
+ * Called for every MSG_BT_DOWN (Keymap_OnKeyDown), with the matrix index the scan found the key at. Returns 1 if the
+ * key was a layer key, which is consumed here, and 0 for a normal key.
+ * The layer of a KM_MO key is recorded against the column of its matrix index, so that it is released with that column.
+ */
+uint8_t Keymap_KeyDown(keymap_t *keymap, uint8_t keyCode, uint8_t keyIndex) {
+	uint8_t	layerMask;
+
+	if (!KM_IS_LAYER_KEY(keyCode)) {
+		return 0;
+	}
+	layerMask = 1 << (keyCode & 0x07);
+
+	if (keyCode & 0x10) {						// KM_TG
+		keymap->toggled ^= layerMask;
+	} else {									// KM_MO
+		keymap->momentaryCol[keyIndex & 0x03] |= layerMask;
+		keymap->momentary |= layerMask;
+	}
+	resolveKeymap(keymap);
+	return 1;
+}
+
+/*
+ * Called for every MSG_BT_UP (Keymap_OnKeyUp). Releases the momentary layers held by that column.
+ */
+void Keymap_KeyUp(keymap_t *keymap, uint8_t colIndex) {
+
+	if (keymap->momentaryCol[colIndex & 0x03]) {
+		keymap->momentary &= ~keymap->momentaryCol[colIndex & 0x03];
+		keymap->momentaryCol[colIndex & 0x03] = 0;
+		resolveKeymap(keymap);
+	}
+}
+
+/*
+ * MSG_BT_DOWN handler: consumes the layer keys
+ */
+uint8_t Keymap_OnKeyDown(msgQueueDef *theMsg) {
+	return Keymap_KeyDown(&keymaps[theMsg->deviceID], theMsg->msgContent, theMsg->keyIndex) ?
+		   DISPATCH_STOP : DISPATCH_CONTINUE;
+}
+
+/*
+ * MSG_BT_UP handler: releases the momentary layers
+ */
+uint8_t Keymap_OnKeyUp(msgQueueDef *theMsg) {
+	Keymap_KeyUp(&keymaps[theMsg->deviceID], theMsg->msgContent);
+	return DISPATCH_CONTINUE;
+}
+
+/*
+ * Build the table read by the ISRs: for each key, walk the active layers from the highest one down to the base layer
+ * and keep the first code that is not transparent.
+ */
+static void resolveKeymap(keymap_t *keymap) {
+	uint8_t	active = keymap->toggled | keymap->momentary | 0x01;
+	uint8_t	key, layer, code;
+
+	for (key = 0; key < 16; key++) {
+		code = 0;
+		for (layer = keymap->nLayers; layer-- > 0; ) {
+			if ((active & (1 << layer)) && (keymap->layers[layer][key] != KM_TRANS)) {
+				code = keymap->layers[layer][key];
+				break;
+			}
+		}
+		keymap->keyMap[key] = code;
+	}
+}
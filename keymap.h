@@ -0,0 +1,52 @@
+/*
+ * keymap.h
+ *
+ *  Author: Ahmed Talaat (aa_talaat@yahoo.com)
+ */
+
+#ifndef KEYMAP_H_
+#define KEYMAP_H_
+
+#include "gpio.h"
+#include "queues.h"
+
+#define KEYMAP_MAX_LAYERS	8
+
+/*
+ * Special codes that can be put in a layer table instead of an ascii code
+ */
+#define KM_TRANS			0xFF				// transparent: use the key of the next active layer below
+#define KM_MO(layer)		(0xE0 | (layer))	// momentary: layer active while the key is held
+#define KM_TG(layer)		(0xF0 | (layer))	// toggle: layer switched on/off at each press
+#define KM_IS_LAYER_KEY(c)	(((c) & 0xE8) == 0xE0)
+
+/*
+ * Default layers, see keymap.c
+ */
+#define LAYER_BASE			0
+#define LAYER_HEX			1
+#define LAYER_CALC			2
+#define LAYER_FN			3
+#define DEFAULT_LAYERS		4
+
+typedef struct keymap_s {
+	const uint8_t	(*layers)[16];				// layer tables in flash, layer 0 is always active
+	uint8_t			nLayers;
+	uint8_t			toggled;					// mask of the layers switched on (by KM_TG or the application)
+	uint8_t			momentary;					// mask of the layers held by a KM_MO key
+	uint8_t			momentaryCol[4];			// layers held by the KM_MO key of each column
+	uint8_t			keyMap[16];					// the active layers resolved into one table, read by the ISRs
+} keymap_t;
+
+extern keymap_t		keymaps[NUM_KEYPADS];
+extern const uint8_t defaultLayers[DEFAULT_LAYERS][16];
+
+void Keymap_Init(void);
+void Keymap_SelectLayers(keymap_t *keymap, const uint8_t (*layers)[16], uint8_t nLayers);
+void Keymap_SetToggled(keymap_t *keymap, uint8_t layerMask);
+uint8_t Keymap_KeyDown(keymap_t *keymap, uint8_t keyCode, uint8_t keyIndex);
+void Keymap_KeyUp(keymap_t *keymap, uint8_t colIndex);
+uint8_t Keymap_OnKeyDown(msgQueueDef *theMsg);
+uint8_t Keymap_OnKeyUp(msgQueueDef *theMsg);
+
+#endif /* KEYMAP_H_ */
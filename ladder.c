@@ -0,0 +1,97 @@
+/*
+ * ladder.c
+ *
+ *  Author: Ahmed Talaat (aa_talaat@yahoo.com)
+ *
+ * Decodes a resistor-ladder keypad from a stream of 12 bits ADC samples. It does not access any peripheral: the samples
+ * are handed over by the ADC DMA ISR (adc_keypad.c) or by a host program feeding a simulated stream.
+ *
+ * The ladder is designed so that key k pulls the input to k*Vref/16 and the pull-up holds it at Vref when no key is
+ * pressed. Each sample is classified in constant time by ladderClassTable[sample >> LADDER_BIN_SHIFT]:
+ *	- +/-96 codes (3 bins) around each nominal level map to the key index, or to LADDER_RELEASED for the top level.
+ *	- The bins in between are LADDER_GUARD: the input is moving from one level to another, or the contact is bad.
+ *
+ * Debouncing is done in the sample domain: a class must be seen on LADDER_DEBOUNCE_SAMPLES consecutive samples before
+ * it replaces the stable one. A guard sample restarts the count. When the stable class changes, the same messages as the
+ * matrix keypad are posted to IsrToMainQueue:
+ *	- MSG_BT_DOWN with the ascii code of the key (from the keyMap given at init, key index = 4*row+col).
+ *	- MSG_BT_UP with the column index (key index % 4) of the key released.
+ */
+#include "stm32f10x.h"
+#include "ladder.h"
+
+ladderState_t	ladderState;
+
+static const uint8_t ladderClassTable[128] = {
+	0, 0, 0, LADDER_GUARD, LADDER_GUARD, 1, 1, 1,
+	1, 1, 1, LADDER_GUARD, LADDER_GUARD, 2, 2, 2,
+	2, 2, 2, LADDER_GUARD, LADDER_GUARD, 3, 3, 3,
+	3, 3, 3, LADDER_GUARD, LADDER_GUARD, 4, 4, 4,
+	4, 4, 4, LADDER_GUARD, LADDER_GUARD, 5, 5, 5,
+	5, 5, 5, LADDER_GUARD, LADDER_GUARD, 6, 6, 6,
+	6, 6, 6, LADDER_GUARD, LADDER_GUARD, 7, 7, 7,
+	7, 7, 7, LADDER_GUARD, LADDER_GUARD, 8, 8, 8,
+	8, 8, 8, LADDER_GUARD, LADDER_GUARD, 9, 9, 9,
+	9, 9, 9, LADDER_GUARD, LADDER_GUARD, 10, 10, 10,
+	10, 10, 10, LADDER_GUARD, LADDER_GUARD, 11, 11, 11,
+	11, 11, 11, LADDER_GUARD, LADDER_GUARD, 12, 12, 12,
+	12, 12, 12, LADDER_GUARD, LADDER_GUARD, 13, 13, 13,
+	13, 13, 13, LADDER_GUARD, LADDER_GUARD, 14, 14, 14,
+	14, 14, 14, LADDER_GUARD, LADDER_GUARD, 15, 15, 15,
+	15, 15, 15, LADDER_GUARD, LADDER_GUARD, LADDER_RELEASED, LADDER_RELEASED, LADDER_RELEASED
+};
+
+static void postLadderChange(ladderState_t *theLadder, uint8_t fromClass, uint8_t toClass);
+
+/*
+ * Start with no key pressed
+ */
+void initializeLadder(ladderState_t *theLadder, const uint8_t *keyMap) {
+	theLadder->keyMap = keyMap;
+	theLadder->stableClass = LADDER_RELEASED;
+	theLadder->candidateClass = LADDER_RELEASED;
+	theLadder->candidateCount = 0;
+}
+
+/*
+ * Classify and debounce a block of samples, posting a message for every accepted key change
+ */
+void processLadderSamples(ladderState_t *theLadder, const uint16_t *samples, uint16_t count) {
+	uint8_t	sampleClass;
+
+	while (count--) {
+		sampleClass = ladderClassTable[(*samples++ & 0x0FFF) >> LADDER_BIN_SHIFT];
+
+		if (sampleClass != theLadder->candidateClass) {	// guard sample or new level, restart the count
+			theLadder->candidateClass = sampleClass;
+			theLadder->candidateCount = 0;
+		}
+		if ((sampleClass == LADDER_GUARD) || (theLadder->candidateCount >= LADDER_DEBOUNCE_SAMPLES)) {
+			continue;
+		}
+		if (++theLadder->candidateCount == LADDER_DEBOUNCE_SAMPLES && sampleClass != theLadder->stableClass) {
+			postLadderChange(theLadder, theLadder->stableClass, sampleClass);
+			theLadder->stableClass = sampleClass;
+		}
+	}
+}
+
+/*
+ * A key going directly to another one (finger sliding on the pad) is reported as an up followed by a down
+ */
+static void postLadderChange(ladderState_t *theLadder, uint8_t fromClass, uint8_t toClass) {
+	msgQueueDef	msg;
+
+	msg.deviceID = 0;
+	if (fromClass != LADDER_RELEASED) {
+		msg.msgID = MSG_BT_UP;
+		msg.msgContent = fromClass % 4;
+		putItemInQueue(&IsrToMainQueue, &msg);
+	}
+	if (toClass != LADDER_RELEASED) {
+		msg.msgID = MSG_BT_DOWN;
+		msg.msgContent = theLadder->keyMap[toClass];
+		msg.keyIndex = toClass;
+		putItemInQueue(&IsrToMainQueue, &msg);
+	}
+}
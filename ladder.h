@@ -0,0 +1,30 @@
+/*
+ * ladder.h
+ *
+ *  Author: Ahmed Talaat (aa_talaat@yahoo.com)
+ */
+
+#ifndef LADDER_H_
+#define LADDER_H_
+
+#include "queues.h"
+
+#define LADDER_KEYS					16
+#define LADDER_RELEASED				0x10		// no key pressed, the pull-up holds the input at Vref
+#define LADDER_GUARD				0xFF		// between two windows, the input is moving
+#define LADDER_BIN_SHIFT			5			// 12 bits sample >> 5 = 128 entries classification table
+#define LADDER_DEBOUNCE_SAMPLES		5			// samples in the same window before a key change is accepted
+
+typedef struct ladderState_s {
+	uint8_t		stableClass;					// last debounced class (key index or LADDER_RELEASED)
+	uint8_t		candidateClass;					// class being confirmed
+	uint8_t		candidateCount;					// consecutive samples of candidateClass
+	const uint8_t	*keyMap;					// ascii code of each key index
+} ladderState_t;
+
+extern ladderState_t	ladderState;
+
+void initializeLadder(ladderState_t *theLadder, const uint8_t *keyMap);
+void processLadderSamples(ladderState_t *theLadder, const uint16_t *samples, uint16_t count);
+
+#endif /* LADDER_H_ */
@@ -32,31 +32,75 @@
  *	- Upon a keypad key is pressed, one of the four columns pin will generate an interrupt.
  *
  EXIT ISR:
-	- Store the exact pin that caused the interrupt.
-	- Mask interrupt, and clear pending interrupt flags.
-	- Trigger the debounce timer to generate an interrupt in 20 ms.
+	- Store the exact pin that caused the interrupt, and clear pending interrupt flags.
+	- Trigger the debounce timer to generate an interrupt in 20 ms (or the adaptive delay of the column, see debounce.c).
+	- The next edges of the column until then are bounce: they are only counted, with the time of the last one.
 	- Return back.
 	
-TIMx ISR:
+TIMx ISR (top half):
 	- This ISR is invoked when a debouncing time has expired.
-	- Disable the debounce timer.
-	- Read the GPIO that caused the interrupt earlier.
+	- A column holding a key whose contact edged in the last 2 ms is losing contact, not released: the delay is re-armed.
+	- Disable the debounce timer, and mask the keypad interrupts.
+	- Latch the keypad port pins, and pend the PendSV exception which runs the rest at the lowest priority.
+
+PendSV ISR (bottom half):
+	- Read the GPIO that caused the interrupt earlier, in the latched pins.
 	- If the GPIO is High:
 		- Change the button state to BT_UP.
 		- Generate a msg BT_UP with value the column index of the key processed
+	- Else, if the column was already down (contact loss of a held key), nothing is posted
 	- Else
 		- Perform row scan to find out the row index corresponding to the button pressed.
 		- Based on the col and row index, find out the ascii code of the button pressed.
 		- Generate a msg BT_DOWN with value the ascii code of the pressed button to be processing in the main loop.
 		- Reconfigure the GPIOs for detecting a button up through the ISR (Row out, Col in) and later on for a new keypad parsing.
 
-	- Enable the buttons interrupt again.
+	- Enable the buttons interrupt again, and pend the EXTI line of any other column whose level changed meanwhile.
 	- Return
 	
 Main Loop:
+	- Every message is handed over to the handlers registered for its type in dispatch_table.h (see dispatch.c).
 	- Upon receiving a button down message, do whatever was planned to do. For debug purpose, turn on LED
 	- Upon receiving a button up message, the msg content has the key index. Change the button state to idle. For debug purpose, turn
-	LED off
+	LED off. The last handler asks the main loop to go to STOP mode.
+	- Every message is also forwarded to the host over USART1 (PA9, 115200 8N1) in CRC protected frames sent by DMA
+	(see frame.h and uart.c). host/kpmon.c decodes them.
+
+Several keypads:
+	- Up to 4 matrix keypads can be connected (NUM_KEYPADS in gpio.h, wiring in keypadConfigs[] of buttons.c). Each one has its
+	own state (keypad_t) and its own TIM4 compare channel for the debounce, so they are debounced independently. The EXTI
+	vectors are shared: the dispatcher reads the pending register once and only handles the lines that fired.
+	- Every message carries the deviceID of the keypad that generated it.
+
+Keymap layers:
+	- Each keypad has a stack of layer tables (keymap.c): base numeric layout, HEX (* and # give E and F), CALC (calculator
+	layout) and FN, held with the D key (FN+1 toggles HEX, FN+2 toggles CALC, FN+3 gives D).
+	- The keymap handler consumes the layer keys and rebuilds the keymap read by the ISRs, which stays a single table lookup.
+
+Resistor-ladder keypads:
+	- When built with KEYPAD_ENGINE_ADC defined, the keypad is a single pin resistor ladder on PA1 sampled by the ADC
+	(see adc_keypad.c and ladder.c). The same messages are posted, and the 8 matrix pins and the EXTI lines are not used.
+	
+Contact health:
+	- The bounce edges and duration of every press and release are averaged per key (health.c), to replace the worn
+	panels early. A key bouncing above the chatter thresholds posts a MSG_KEY_CHATTER message, sent to the host.
+
+Adaptive debounce:
+	- Built with KEYPAD_ADAPTIVE_DEBOUNCE, the press debounce delay of each column follows the bounce measured on it
+	(debounce.c), between 3 and 20 ms. host/keysim.c runs the keypad ISRs against simulated bounce to check it.
+
+Key sequences:
+	- The application (app.c) reads key sequences as flows (flow.h): stackless coroutines written as straight code that wait for the
+	next key, or for the next key with a timeout. pinFlow replaces the old password state machine and adds a timeout
+	between the digits, layoutFlow switches the CALC layout with * then #.
+	- The flow frames come from a static pool. The timeouts are counted by the RTC from the LSI (wakeup.c), whose alarm
+	wakes the device up from STOP mode: a flow waiting with a timeout does not keep the main loop out of STOP mode.
+
+Interrupt storms:
+	- Every keypad EXTI line has a token bucket (storm.c): a line toggling faster than a key can bounce (broken cable, EMI)
+	runs out of tokens and is masked for 100 ms, doubled at every new quarantine up to 12.8 s, and a MSG_LINE_FAULT message
+	is sent to the host. The other columns and keypads keep working, and the keypad interrupts cannot take more than a
+	bounded share of the CPU.
 	
 Unhandled cases:
 	- What will happen in the user presses one key down, and while down, he presses a second key down, then release both in any order?
@@ -66,18 +110,16 @@ Unhandled cases:
 
 /* Includes */
 #include "stm32f10x.h"
-#include "gpio.h"
-#include "TIM4.h"
 #include "queues.h"
-#include "buttons.h"
+#include "uart.h"
+#include "dispatch.h"
+#include "flow.h"
+#include "app.h"
 
 /* Private functions */
 void HSI_RCC_Configuration(void);
 void Config_NVIC(void);
-uint8_t	checkPassword(uint8_t keyPressed);
-
-uint8_t	passwordIndex=0;
-uint8_t password[4];
+void Enter_LowPower(void);
 
 int main(void) {
 
@@ -87,49 +129,44 @@ int main(void) {
 
 	initializeQueue(&IsrToMainQueue);
 
+	PROFILE_INIT();						// DWT cycle counter, when built with KEYPAD_PROFILE
+
 	HSI_RCC_Configuration();			// Configure system clock to HSI @ 8MHz
 
 	// Configure two bits for preemption and two bits for priority
 	NVIC_PriorityGroupConfig(NVIC_PriorityGroup_2);
 	Config_NVIC();
 
-	TIM4_Configuration ();				// Configure the debounce timer
-
-	GPIO_SetAllAnalogInput();			// change all IOs into Analog INP to save power
-
-	GPIO_ConfigDiscoveryLEDs();			// Debug using Discovery 2 LEDs
-
-	Config_Keypad(ROW_OUT_COL_IN);		// initially configure colum pins as input that generate interrupts and row as output
+	App_Init();							// peripherals, keypads and flows of the application (app.c)
 
 										// Go to STOP mode to save power and wait for a key to be pressed to enter the main loop
-	PWR_EnterSTOPMode(PWR_Regulator_LowPower, PWR_STOPEntry_WFI);
+	Enter_LowPower();
 
 	while (1)  {						// Infinite loop
 
     	rc = getItemFromQueue(&IsrToMainQueue,&readValue);
 
     	if (rc != 0xff) {	//queue is not empty
-			switch (readValue.msgID) {
-				case MSG_BT_DOWN:						// A button down was detected, and the msg content holds the
-														// ascii code of the key pressed
-					GPIO_SetBits(LED_PORT, LED_BLUE_PIN);
-														// Test if the content = 1234 as a test password
-					if (checkPassword(readValue.msgContent)) {
-						LED_PORT->ODR ^= LED_GREEN_PIN;	// Toggle Green LED
-					}
-					break;
-
-				case MSG_BT_UP:							// Rest specific button status to idle
-					GPIO_ResetBits(LED_PORT, LED_BLUE_PIN);
-					keypadColState[readValue.msgContent] = BT_IDLE;
-														// key full processed, then go to STOP mode to save power
-					PWR_EnterSTOPMode(PWR_Regulator_LowPower, PWR_STOPEntry_WFI);
-					break;
-
-				default:
-
-					break;
-			}
+    		dispatchMessage(&readValue);	// call the handlers registered in dispatch_table.h
+    	}
+
+    	if (Flow_Poll()) {					// resume the flows whose timeout has expired, then back to STOP mode
+    		lowPowerRequest = 1;
+    	}
+
+    	if (lowPowerRequest) {				// key fully processed, then go to STOP mode to save power
+    		UART_WaitIdle();				// once the pending frames are out
+    		if (App_StopAllowed()) {
+    			Enter_LowPower();
+    		} else {						// SysTick, needed by storm.c, stops in STOP mode: only sleep until the next tick or key
+    			__WFI();
+    		}
+    	} else if (rc == 0xff) {			// key held: sleep until the next message. PRIMASK keeps the ISRs from posting
+    		__disable_irq();				// between the test and WFI, which still wakes up on the pending interrupt
+    		if (isEmpty(&IsrToMainQueue)) {
+    			__WFI();
+    		}
+    		__enable_irq();
     	}
 	}
 }
@@ -146,6 +183,27 @@ void Config_NVIC(void){
 	NVIC_InitStructure.NVIC_IRQChannelSubPriority = 0x0F;
 	NVIC_InitStructure.NVIC_IRQChannelCmd = ENABLE;
 	NVIC_Init(&NVIC_InitStructure);
+
+#if NUM_KEYPADS > 1
+	/* The second keypad columns are on EXTI5-8 */
+	NVIC_InitStructure.NVIC_IRQChannel = EXTI9_5_IRQn;
+	NVIC_Init(&NVIC_InitStructure);
+#endif
+
+	/* PendSV runs the keypad decoding deferred by the TIM4 ISR, below all the interrupts */
+	NVIC_SetPriority(PendSV_IRQn, 0xFF);
+}
+
+/*
+ * Wait for the next key with the lowest power mode allowed by the keypad engine. The matrix keypad wakes the device up
+ * from STOP mode through its EXTI lines, while the resistor-ladder keypad needs the ADC, TIM3 and DMA clocks running.
+ */
+void Enter_LowPower(void) {
+#ifdef KEYPAD_ENGINE_ADC
+	__WFI();
+#else
+	PWR_EnterSTOPMode(PWR_Regulator_LowPower, PWR_STOPEntry_WFI);
+#endif
 }
 
 /*
@@ -173,49 +231,3 @@ void HSI_RCC_Configuration(void)
   RCC_APB1PeriphClockCmd(RCC_APB1Periph_PWR, ENABLE);
 }
 
-
-/*
- * This function checks the pressed used button. If it matches the right sequence, it returns TRUE, else reset, and return FALSE
- */
-uint8_t	checkPassword(uint8_t keyPressed) {
-
-	switch (passwordIndex) {
-		case 0:
-			if (keyPressed == '1') {
-				passwordIndex++;
-			} else {
-				passwordIndex = 0;
-			}
-			break;
-		case 1:
-			if (keyPressed == '2') {
-				passwordIndex++;
-			} else {
-				passwordIndex = 0;
-			}
-
-			break;
-		case 2:
-			if (keyPressed == '3') {
-				passwordIndex++;
-			} else {
-				passwordIndex = 0;
-			}
-
-			break;
-		case 3:
-			if (keyPressed == '4') {
-				passwordIndex = 0;
-				return 1;
-			} else {
-				passwordIndex = 0;
-			}
-
-			break;
-
-		default:
-			break;
-	}
-	return 0;
-
-}
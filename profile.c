@@ -0,0 +1,24 @@
+/*
+ * profile.c
+ *
+ *  Author: Ahmed Talaat (aa_talaat@yahoo.com)
+ *
+ * Accumulation of the DWT cycle measurements, see profile.h
+ */
+#include "stm32f10x.h"
+#include "profile.h"
+
+#ifdef KEYPAD_PROFILE
+
+/*
+ * Add one measurement. Called from ISRs too, so the statistics of a section must only be updated from one context.
+ */
+void profileRecord(profileStat_t *theStat, uint32_t cycles) {
+	theStat->count++;
+	theStat->totalCycles += cycles;
+	if (cycles > theStat->maxCycles) {
+		theStat->maxCycles = cycles;
+	}
+}
+
+#endif
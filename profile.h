@@ -0,0 +1,42 @@
+/*
+ * profile.h
+ *
+ *  Author: Ahmed Talaat (aa_talaat@yahoo.com)
+ *
+ * Cycle accurate measurement of code sections with the Cortex-M3 DWT cycle counter. Only compiled in when
+ * KEYPAD_PROFILE is defined, otherwise the macros are empty and cost nothing.
+ *
+ *	PROFILE_START(t);				// t is a local uint32_t
+ *	... measured code ...
+ *	PROFILE_STOP(t, &someStat);		// adds the elapsed cycles to someStat
+ *
+ * The results are read with the debugger (count, total and worst case cycles of each profileStat_t).
+ */
+
+#ifndef PROFILE_H_
+#define PROFILE_H_
+
+typedef struct profileStat_s {
+	uint32_t	count;
+	uint32_t	totalCycles;
+	uint32_t	maxCycles;
+} profileStat_t;
+
+#ifdef KEYPAD_PROFILE
+
+#define PROFILE_INIT()			do { CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA; DWT->CYCCNT = 0; \
+									 DWT->CTRL |= DWT_CTRL_CYCCNTENA; } while (0)
+#define PROFILE_START(t)		((t) = DWT->CYCCNT)
+#define PROFILE_STOP(t, stat)	profileRecord((stat), DWT->CYCCNT - (t))
+
+void profileRecord(profileStat_t *theStat, uint32_t cycles);
+
+#else
+
+#define PROFILE_INIT()
+#define PROFILE_START(t)		((t) = 0)
+#define PROFILE_STOP(t, stat)	((void) (t))
+
+#endif
+
+#endif /* PROFILE_H_ */
@@ -34,7 +34,9 @@ void initializeQueue(circularQueue_t *theQueue) {
 
     for(i=0; i<MAX_ITEMS; i++) {
     	theQueue->data[i].msgID = 0;
+    	theQueue->data[i].deviceID = 0;
     	theQueue->data[i].msgContent = 0;
+    	theQueue->data[i].keyIndex = 0;
     }
     return;
 }
@@ -54,33 +56,51 @@ uint8_t isEmpty(circularQueue_t *theQueue) {
  * The putItem function, verifies if there is space in the queue, and returns 0xFF if the queue is full or add an item
  * at the end of the queue (theQueue->last element). Then it updates the value of theQueue->last the modulus operator
  * is needed to stay into the boundaries of the array and return 1.
+ * The ISRs posting to the queue run at different priorities (PendSV, SysTick, DMA), and the main loop takes the items
+ * out: the queue is updated with the interrupts disabled, and PRIMASK restored so that it can be called from any level.
  */
 uint8_t putItemInQueue(circularQueue_t *theQueue, msgQueueDef *theItemValue) {
+    uint32_t    primask;
+    uint8_t     rc;
 
+    primask = __get_PRIMASK();
+    __disable_irq();
     if(theQueue->validItems>=MAX_ITEMS) {
-        return(0xFF);
+        rc = 0xFF;
     } else {
         theQueue->validItems++;
         theQueue->data[theQueue->last].msgID = theItemValue->msgID;
+        theQueue->data[theQueue->last].deviceID = theItemValue->deviceID;
         theQueue->data[theQueue->last].msgContent = theItemValue->msgContent;
+        theQueue->data[theQueue->last].keyIndex = theItemValue->keyIndex;
         theQueue->last = (theQueue->last+1)%MAX_ITEMS;
-        return(1);
+        rc = 1;
     }
+    __set_PRIMASK(primask);
+    return(rc);
 }
 
 /*
  * The getItem function returns 0xFF if the queue is empty, otherwise it takes the first element into the queue, then it updates
- * the number of items and the first element of the queue (look at modulus operator).
+ * the number of items and the first element of the queue (look at modulus operator). Same critical section as putItem.
  */
 uint8_t getItemFromQueue(circularQueue_t *theQueue, msgQueueDef *theItemValue) {
+    uint32_t    primask;
+    uint8_t     rc;
 
+    primask = __get_PRIMASK();
+    __disable_irq();
     if(isEmpty(theQueue)) {
-        return(0xFF);
+        rc = 0xFF;
     } else {
         theItemValue->msgID=theQueue->data[theQueue->first].msgID;
+        theItemValue->deviceID=theQueue->data[theQueue->first].deviceID;
         theItemValue->msgContent=theQueue->data[theQueue->first].msgContent;
+        theItemValue->keyIndex=theQueue->data[theQueue->first].keyIndex;
         theQueue->first=(theQueue->first+1)%MAX_ITEMS;
         theQueue->validItems--;
-        return(0);
+        rc = 0;
     }
+    __set_PRIMASK(primask);
+    return(rc);
 }
@@ -12,12 +12,14 @@
 /*
  * Type of messages we will deal with
  */
-typedef enum {	MSG_BT_DOWN, MSG_BT_UP } MSGID;
+typedef enum {	MSG_BT_DOWN, MSG_BT_UP, MSG_KEY_CHATTER, MSG_LINE_FAULT, MSG_COUNT } MSGID;
 
 typedef	struct						// queue element content
 {
 	  MSGID msgID;
+	  uint8_t deviceID;			// keypad that generated the message
 	  uint8_t msgContent;
+	  uint8_t keyIndex;			// MSG_BT_DOWN and MSG_KEY_CHATTER: matrix index of the key (4*row+col), 0xFF if none
 } msgQueueDef;
 
 typedef struct circularQueue_s {
@@ -32,6 +32,17 @@
 #include "TIM4.h"
 #include "buttons.h"
 #include "queues.h"
+#include "uart.h"
+#include "profile.h"
+#include "flow.h"
+#include "health.h"
+#include "debounce.h"
+#include "storm.h"
+#include "tick.h"
+#include "wakeup.h"
+#ifdef KEYPAD_ENGINE_ADC
+#include "adc_keypad.h"
+#endif
 
 /** @addtogroup STM32F10x_StdPeriph_Template
   * @{
@@ -42,11 +53,20 @@
 
 /* Private macro -------------------------------------------------------------*/
 /* Private variables ---------------------------------------------------------*/
-uint8_t keypadColIndex;
-uint16_t keypadPin;
 msgQueueDef msgContent;
+volatile uint8_t bottomHalfPending = 0;			// keypads latched by the TIM4 top half, to decode in PendSV
+#ifdef KEYPAD_PROFILE
+profileStat_t debounceTopHalfProfile;			// cycles spent in TIM4_IRQHandler
+profileStat_t debounceBottomHalfProfile;		// cycles spent in PendSV_Handler
+#endif
 
 /* Private function prototypes -----------------------------------------------*/
+static void keypadExtiDispatch(void);
+static void keypadBottomHalf(void);
+static void keypadDebounceExpired(keypad_t *keypad);
+static void keypadReleaseLines(uint16_t lines);
+static void keypadPendMissedColumns(keypad_t *keypad);
+
 /* Private functions ---------------------------------------------------------*/
 
 /******************************************************************************/
@@ -54,40 +74,77 @@ msgQueueDef msgContent;
 /******************************************************************************/
 
 /**
-  * @brief  This function handles RTC global interrupt request.
+  * @brief  This function handles External lines 15 to 10 interrupt request.
   * @param  None
   * @retval None
   */
 
 /*
- * Handle the interrupt generated when a user button is pressed/released. It will find out which set of column keys were pressed on the
- * keypad. Will read the current GPIO PIN value, and check the previous button status to take a decision if this is a valid
- * sequence or not. If valid, then it will trigger the debounce timer otherwise, it will
+ * Handle the interrupt generated when a user button is pressed/released. The keypads share the EXTI vectors, the
+ * dispatcher finds out which keypad and column fired.
  */
 void EXTI15_10_IRQHandler(void)
 {
-	if(EXTI_GetITStatus(EXTI_Line12) != RESET) {
-		keypadColIndex=0;
-		keypadPin = KEYPAD_COL1;
-	} else
+	keypadExtiDispatch();
+}
 
-	if(EXTI_GetITStatus(EXTI_Line13) != RESET) {
-		keypadColIndex=1;
-		keypadPin = KEYPAD_COL2;
-	} else
+/**
+  * @brief  This function handles External lines 9 to 5 interrupt request.
+  * @param  None
+  * @retval None
+  */
+void EXTI9_5_IRQHandler(void)
+{
+	keypadExtiDispatch();
+}
+
+/*
+ * Read the pending register once, and walk only the lines that fired. For each of them, keypadLineOwner gives the keypad
+ * and the column. The first edge starts the debounce timer channel of the keypad. The following ones of the same column,
+ * until the debounce delay expires, are only counted with the time of the last one for the contact statistics
+ * (health.c): the lines stay enabled, but the bounce does not change the key being debounced. The edges of the other
+ * columns are left to keypadPendMissedColumns. The other keypads are left untouched.
+ * The lines of a keypad are cleared as soon as one of them is handled, so a keypad is handled once even if several of
+ * its columns fired together.
+ * Every edge is charged to the token bucket of its line (storm.c). A line out of tokens is masked: it still ends the
+ * window it is bouncing in, but a quarantined line does not start a new one.
+ */
+static void keypadExtiDispatch(void)
+{
+	uint32_t	pending = EXTI->PR & EXTI->IMR & keypadExtiLines;
+	uint32_t	primask;
+	uint8_t		line, owner;
+	keypad_t	*keypad;
 
-	if(EXTI_GetITStatus(EXTI_Line14) != RESET)  {
-		keypadColIndex=2;
-		keypadPin = KEYPAD_COL3;
-	} else
+	while (pending) {
+		line = 31 - __CLZ(pending);
+		owner = keypadLineOwner[line];
+		keypad = &keypads[owner >> 2];
+		pending &= ~keypad->colMask;
 
-	if(EXTI_GetITStatus(EXTI_Line15) != RESET)  {
-		keypadColIndex=3;
-		keypadPin = KEYPAD_COL4;
+		primask = __get_PRIMASK();						// the TIM4 top half may end the debounce meanwhile
+		__disable_irq();
+		if (EXTI->IMR & keypad->colMask) {				// not masked by the TIM4 top half since PR was read
+			EXTI_ClearITPendingBit(keypad->colMask);
+			if (keypad->debouncing) {					// bounce: count it, the debounce delay keeps running
+				Storm_Charge(line, STORM_EDGE_COST);
+				if ((owner & 0x03) == keypad->colIndex) {	// the other columns are checked once it expires
+					if (keypad->bounceEdges != 0xFF) {
+						keypad->bounceEdges++;
+					}
+					keypad->lastEdge = TIM_GetCounter(TIM4);
+				}
+			} else if (Storm_Charge(line, STORM_WINDOW_COST)) {
+				keypad->colIndex = owner & 0x03;
+				keypad->debouncing = 1;
+				keypad->bounceEdges = 0;
+				keypad->delayMs = DEBOUNCE_DELAY(keypad, keypad->colIndex);
+				enableDebounceTimer(keypad->id, keypad->delayMs);
+				keypad->bounceStart = keypad->lastEdge = TIM_GetCounter(TIM4);
+			}
+		}
+		__set_PRIMASK(primask);
 	}
-
-	DisableKeypadExti_IRQ();							// Disable interrupt to avoid any debounce effects
-	enableDebounceTimer();
 }
 
 
@@ -98,37 +155,194 @@ void EXTI15_10_IRQHandler(void)
   */
 
 /*
- * triggered after 20 ms from enabling the timer in the exti ISR.
- * It will disable the timer and clear its interrupt flags
- * It will read the tested button GPIO and update its status accordingly. If a valid state, will post a message
- * to the main program loop accordingly
+ * Top half, triggered after the debounce delay (20 ms, or the adaptive delay of the column) from enabling a keypad channel
+ * of the timer in the exti ISR.
+ * TIM4 has the highest priority, so it only does the time critical part for the keypads whose channel expired: stop the
+ * channel and latch the keypad port pins before they can change. The decoding is left to the bottom half, run from
+ * PendSV at the lowest priority, so the other interrupts are only delayed by a few register accesses when a key is pressed,
+ * instead of the whole decoding. Built with KEYPAD_TOP_HALF_DECODE, the bottom half is run here instead (former behaviour):
+ * debounceTopHalfProfile of a KEYPAD_PROFILE build gives the cycles TIM4 holds off the USART1 DMA interrupt in both cases.
  */
 void TIM4_IRQHandler(void)
 {
-	if (TIM_GetITStatus(TIM4, TIM_IT_Update) != RESET)  {
+	uint16_t	expired = TIM4->SR & TIM4->DIER & DEBOUNCE_IT_ALL;
+	uint8_t		channel;
+	uint32_t	start;
+
+	PROFILE_START(start);
+	while (expired) {
+		channel = 30 - __CLZ(expired);					// TIM_IT_CC1 is bit 1
+		expired &= ~(1 << (channel + 1));
+
+#ifdef KEYPAD_ADAPTIVE_DEBOUNCE
+		if (Debounce_Extend(&keypads[channel])) {		// still bouncing at the end of a shortened delay
+			continue;
+		}
+#endif
+		if (Debounce_ExtendHeld(&keypads[channel])) {	// a held key losing contact again, not released yet
+			continue;
+		}
+		disableDebounceTimer(channel);
+		DisableKeypadExti_IRQ(&keypads[channel]);		// end of the bounce counting, the decoding drives the pins
+		keypads[channel].debouncing = 0;
+		keypads[channel].snapshot = GPIO_ReadInputData(keypads[channel].config->port);
+		bottomHalfPending |= 1 << channel;
+	}
+#ifdef KEYPAD_TOP_HALF_DECODE
+	keypadBottomHalf();
+#else
+	SCB->ICSR = SCB_ICSR_PENDSVSET;						// run the bottom half once no other interrupt is active
+#endif
+	PROFILE_STOP(start, &debounceTopHalfProfile);
+}
+
+/*
+ * Bottom half: decode the keypads latched by the TIM4 top half. Runs at the lowest priority (PendSV), so the top half
+ * may latch a new keypad while it runs: the pending mask is taken and cleared with the interrupts disabled.
+ */
+static void keypadBottomHalf(void)
+{
+	uint32_t	primask;
+	uint8_t		pending, id;
+
+	primask = __get_PRIMASK();
+	__disable_irq();
+	pending = bottomHalfPending;
+	bottomHalfPending = 0;
+	__set_PRIMASK(primask);
+
+	while (pending) {
+		id = 31 - __CLZ(pending);
+		pending &= ~(1 << id);
+		keypadDebounceExpired(&keypads[id]);
+	}
+}
+
+/*
+ * It will check the tested button GPIO in the latched port pins and update its status accordingly. If a valid state,
+ * will post a message to the main program loop accordingly. A column still down is not decoded again: the edges were a
+ * contact loss of the held key.
+ */
+static void keypadDebounceExpired(keypad_t *keypad)
+{
+	uint8_t	colIndex = keypad->colIndex;
+	uint8_t	bounceMs = Debounce_BounceMs(keypad);
 
-	  disableDebounceTimer();
-	  if (GPIO_ReadInputDataBit(KEYPAD_PORT, keypadPin)) {
-		  	  	  	  	  	  	  	  	  	  	  	// We read a high bit
-		keypadColState[keypadColIndex] = BT_UP;		// Update state to up
+#ifdef KEYPAD_ADAPTIVE_DEBOUNCE
+	Debounce_Adapt(keypad, colIndex, keypad->bounceEdges, bounceMs);
+#endif
+	msgContent.deviceID = keypad->id;
+	if (keypad->snapshot & keypad->config->colPins[colIndex]) {
+												// We read a high bit
+		keypad->colState[colIndex] = BT_UP;		// Update state to up
 		msgContent.msgID = MSG_BT_UP;
-		msgContent.msgContent = keypadColIndex;		// Let the main loop knows which key was pressed up
+		msgContent.msgContent = colIndex;		// Let the main loop knows which key was pressed up
 		putItemInQueue(&IsrToMainQueue, &msgContent);	// post a message to the main loop that a valid button up was detected
-	  } else {										// We read a low bit, so see which valid transition we can handle
-		keypadColState[keypadColIndex] = BT_DOWN;
+		if (keypad->colKey[colIndex] != KEYPAD_NO_KEY) {
+			Health_Record(keypad->id, keypad->colKey[colIndex], 0, keypad->bounceEdges, bounceMs);
+		}
+	} else if (keypad->colState[colIndex] == BT_DOWN) {
+												// Low again after a contact loss while the key is held (chatter):
+												// the key was never released, so no new button down
+		if (keypad->colKey[colIndex] != KEYPAD_NO_KEY) {
+			Health_Record(keypad->id, keypad->colKey[colIndex], 1, keypad->bounceEdges, bounceMs);
+		}
+	} else {									// We read a low bit, so see which valid transition we can handle
+		keypad->colState[colIndex] = BT_DOWN;
 		msgContent.msgID = MSG_BT_DOWN;
 												// Get the ascii code of the button pressed based on column index
 												// and extra scanning of rows
-		msgContent.msgContent = getKeyPressed(keypadColIndex);
+		msgContent.msgContent = getKeyPressed(keypad, colIndex);
+		msgContent.keyIndex = keypad->colKey[colIndex];
 												// post a message to the main loop that a valid button down was detected
 		putItemInQueue(&IsrToMainQueue, &msgContent);
+		if (keypad->colKey[colIndex] != KEYPAD_NO_KEY) {
+			Health_Record(keypad->id, keypad->colKey[colIndex], 1, keypad->bounceEdges, bounceMs);
+		}
 
-		Config_Keypad(ROW_OUT_COL_IN);			// Configure column pins as input that generate interrupts and
+		Config_Keypad(keypad, ROW_OUT_COL_IN);	// Configure column pins as input that generate interrupts and
 												// row as output
-	  	}
-	  EnableKeypadExti_IRQ();							// Enable interrupt again to parse a new key
-  }
+	}
+	EnableKeypadExti_IRQ(keypad);				// Enable interrupt again to parse a new key
+	keypadPendMissedColumns(keypad);
+}
+
+/*
+ * The edges of the other columns during the debounce delay were counted as bounce of the column debounced (a key
+ * pressed while noise toggles another column), and EnableKeypadExti_IRQ cleared the edges of the decoded column since
+ * the TIM4 latch (a key released before the bottom half ran). A column now reading a level its state does not have gets
+ * its EXTI line pended by software, so the dispatcher debounces it next. The quarantined lines are masked, and stay
+ * untouched.
+ */
+static void keypadPendMissedColumns(keypad_t *keypad)
+{
+	uint16_t	levels = GPIO_ReadInputData(keypad->config->port);
+	uint16_t	pin;
+	uint8_t		col;
+
+	for (col = 0; col < 4; col++) {
+		pin = keypad->config->colPins[col];
+		if (!(levels & pin) != (keypad->colState[col] == BT_DOWN)) {
+			EXTI_GenerateSWInterrupt(pin);
+		}
+	}
+}
+
+/**
+  * @brief  This function handles DMA1 Channel 4 interrupt request.
+  * @param  None
+  * @retval None
+  */
+
+/*
+ * Triggered when the DMA has handed over a complete frame to USART1. Let the UART module send the events that were
+ * collected in the meantime.
+ */
+void DMA1_Channel4_IRQHandler(void)
+{
+	if (DMA_GetITStatus(DMA1_IT_TC4) != RESET) {
+		DMA_ClearITPendingBit(DMA1_IT_GL4);
+		UART_TxComplete();
+	}
+}
+
+/**
+  * @brief  This function handles RTC Alarm interrupt request (EXTI line 17).
+  * @param  None
+  * @retval None
+  */
+
+/*
+ * The RTC reached the date of the next flow timeout (wakeup.c): the main loop, woken up from STOP mode, resumes the
+ * flows in Flow_Poll()
+ */
+void RTCAlarm_IRQHandler(void)
+{
+	Wakeup_Alarm();
+}
+
+#ifdef KEYPAD_ENGINE_ADC
+/**
+  * @brief  This function handles DMA1 Channel 1 interrupt request.
+  * @param  None
+  * @retval None
+  */
+
+/*
+ * Triggered each time the DMA has filled one half of the resistor-ladder samples buffer
+ */
+void DMA1_Channel1_IRQHandler(void)
+{
+	if (DMA_GetITStatus(DMA1_IT_HT1) != RESET) {
+		DMA_ClearITPendingBit(DMA1_IT_HT1);
+		ADCKeypad_ProcessHalf(0);
+	}
+	if (DMA_GetITStatus(DMA1_IT_TC1) != RESET) {
+		DMA_ClearITPendingBit(DMA1_IT_TC1);
+		ADCKeypad_ProcessHalf(1);
+	}
 }
+#endif
 
 /**
   * @brief  This function handles NMI exception.
@@ -216,6 +430,50 @@ void DebugMon_Handler(void)
   */
 void PendSV_Handler(void)
 {
+	uint32_t	start;
+
+	PROFILE_START(start);
+	keypadBottomHalf();
+	PROFILE_STOP(start, &debounceBottomHalfProfile);
+}
+
+/**
+  * @brief  This function handles SysTick Handler.
+  * @param  None
+  * @retval None
+  */
+void SysTick_Handler(void)
+{
+	uint16_t	released;
+
+	tickMs++;								// only running while a module holds the tick (tick.c)
+	released = Storm_Tick();
+	if (released) {
+		keypadReleaseLines(released);
+	}
+}
+
+/*
+ * Unmask the EXTI lines released from quarantine by storm.c. The lines of a keypad latched by the TIM4 top half stay
+ * masked: the bottom half enables them with the others once the keypad is decoded. SysTick and PendSV have the same
+ * priority, so this never runs in the middle of a decoding.
+ */
+static void keypadReleaseLines(uint16_t lines)
+{
+	uint32_t	primask;
+	uint16_t	keypadLines;
+	uint8_t		id;
+
+	primask = __get_PRIMASK();
+	__disable_irq();
+	for (id = 0; id < NUM_KEYPADS; id++) {
+		keypadLines = lines & keypads[id].colMask;
+		if (keypadLines && !(bottomHalfPending & (1 << id))) {
+			EXTI_ClearITPendingBit(keypadLines);
+			EXTI->IMR |= keypadLines;
+		}
+	}
+	__set_PRIMASK(primask);
 }
 
 /******************************************************************************/
@@ -0,0 +1,176 @@
+/*
+ * storm.c
+ *
+ *  Author: Ahmed Talaat (aa_talaat@yahoo.com)
+ *
+ * Interrupt storm protection of the keypad EXTI lines. A broken cable, a shorted contact or EMI can toggle a column
+ * line thousands of times per second: every edge runs the EXTI ISR, and every debounce window the TIM4 and PendSV
+ * ones, so the main loop would never get back to STOP mode.
+ *
+ * Each EXTI line has a token bucket of STORM_BUCKET tokens. The EXTI ISR charges STORM_WINDOW_COST for the edge that
+ * starts a debounce window and STORM_EDGE_COST for the bounce edges (Storm_Charge). The tokens are given back at one per
+ * STORM_REFILL_MS by the 1 ms tick (tick.c), held while a bucket is not full. SysTick does not count in STOP mode, so
+ * the main loop refills all the buckets when it goes to STOP after a key release (Storm_Rest): the keypads were idle.
+ *
+ * A line that runs out of tokens is quarantined:
+ *	- its EXTI line is masked at once, and MSG_LINE_FAULT is posted with the column as content,
+ *	- after backoffMs (STORM_BACKOFF_MS, doubled at each quarantine up to STORM_BACKOFF_MAX_MS) the tick releases it
+ *	  with a full bucket (SysTick_Handler unmasks it),
+ *	- it is then on probation for as long again: a new quarantine meanwhile doubles the backoff, otherwise the backoff
+ *	  starts from STORM_BACKOFF_MS again.
+ * The main loop does not go to STOP mode while a line is quarantined or on probation, the tick must run.
+ *
+ * Ceiling: while the tick runs, a line costs at most STORM_BUCKET + t / STORM_REFILL_MS edges over t ms, i.e. 1000
+ * EXTI calls per second, or 250 debounce windows per second. A quarantined line costs nothing but the 1 ms tick.
+ * The keypads of the other lines keep working meanwhile. host/keysim.c checks it with the "noise" workload; its
+ * cpu_share_max rests on the estimated handler costs of the simulator, the edge and window counts above do not.
+ */
+
+#include "stm32f10x.h"
+#include "storm.h"
+#include "buttons.h"
+#include "tick.h"
+
+lineGuard_t				lineGuards[16];
+volatile uint16_t		stormQuarantinedLines;
+
+static uint16_t			stormActiveLines;		// lines holding the tick: bucket not full, quarantine or probation
+static uint16_t			stormProbationLines;
+
+/*
+ * All the lines with a full bucket and no fault history
+ */
+void Storm_Init(void) {
+	uint8_t	line;
+
+	for (line = 0; line < 16; line++) {
+		lineGuards[line].tokens = STORM_BUCKET;
+		lineGuards[line].backoffMs = 0;
+		lineGuards[line].faults = 0;
+	}
+	stormQuarantinedLines = 0;
+	stormProbationLines = 0;
+	stormActiveLines = 0;
+}
+
+/*
+ * Take the cost of an edge from the bucket of its line. Called by the EXTI ISR with the interrupts disabled.
+ * Returns 1 if the line had the tokens, 0 if it was quarantined: its EXTI line is masked and the fault posted.
+ */
+uint8_t Storm_Charge(uint8_t line, uint8_t cost) {
+	lineGuard_t	*guard = &lineGuards[line];
+	uint16_t	bit = 1 << line;
+	msgQueueDef	msg;
+
+	if (!(stormActiveLines & bit)) {
+		if (stormActiveLines == 0) {
+			Tick_Request(TICK_STORM);
+		}
+		stormActiveLines |= bit;
+	}
+	if (guard->tokens >= cost) {
+		guard->tokens -= cost;
+		return 1;
+	}
+
+	guard->tokens = 0;
+	EXTI->IMR &= ~bit;
+	EXTI_ClearITPendingBit(bit);
+	stormQuarantinedLines |= bit;
+	stormProbationLines &= ~bit;
+	if (guard->backoffMs == 0) {
+		guard->backoffMs = STORM_BACKOFF_MS;
+	} else if (guard->backoffMs < STORM_BACKOFF_MAX_MS) {
+		guard->backoffMs <<= 1;
+	}
+	guard->deadline = tickMs + guard->backoffMs;
+	if (guard->faults != 0xFFFF) {
+		guard->faults++;
+	}
+
+	msg.msgID = MSG_LINE_FAULT;
+	msg.deviceID = keypadLineOwner[line] >> 2;
+	msg.msgContent = keypadLineOwner[line] & 0x03;
+	msg.keyIndex = KEYPAD_NO_KEY;
+	putItemInQueue(&IsrToMainQueue, &msg);
+	return 0;
+}
+
+/*
+ * Called from SysTick_Handler every ms: refill the buckets, end the quarantines and probations that are due.
+ * Returns the lines released from quarantine, for the caller to unmask.
+ */
+uint16_t Storm_Tick(void) {
+	static uint8_t	refillPhase;
+	lineGuard_t		*guard;
+	uint16_t		lines = stormActiveLines, released = 0, bit;
+	uint8_t			line, refill;
+
+	if (lines == 0) {
+		return 0;
+	}
+	refill = (++refillPhase >= STORM_REFILL_MS);
+	if (refill) {
+		refillPhase = 0;
+	}
+	while (lines) {
+		line = 31 - __CLZ(lines);
+		bit = 1 << line;
+		lines &= ~bit;
+		guard = &lineGuards[line];
+
+		if (stormQuarantinedLines & bit) {
+			if ((int16_t) (tickMs - guard->deadline) >= 0) {
+				stormQuarantinedLines &= ~bit;
+				stormProbationLines |= bit;
+				guard->tokens = STORM_BUCKET;
+				guard->deadline = tickMs + guard->backoffMs;
+				released |= bit;
+			}
+			continue;
+		}
+		if ((stormProbationLines & bit) && ((int16_t) (tickMs - guard->deadline) >= 0)) {
+			stormProbationLines &= ~bit;
+			guard->backoffMs = 0;
+		}
+		if (refill && (guard->tokens < STORM_BUCKET)) {
+			guard->tokens++;
+		}
+		if ((guard->tokens == STORM_BUCKET) && !(stormProbationLines & bit)) {
+			stormActiveLines &= ~bit;
+		}
+	}
+	if (stormActiveLines == 0) {
+		Tick_Release(TICK_STORM);
+	}
+	return released;
+}
+
+/*
+ * Called by the main loop before going to STOP mode. Returns 0 if a line is quarantined or on probation: the tick must
+ * keep running. Otherwise the keypads were idle, all the buckets are refilled and the tick is released.
+ */
+uint8_t Storm_Rest(void) {
+	uint32_t	primask;
+	uint16_t	lines;
+	uint8_t		line;
+
+	primask = __get_PRIMASK();
+	__disable_irq();
+	if (stormQuarantinedLines | stormProbationLines) {
+		__set_PRIMASK(primask);
+		return 0;
+	}
+	lines = stormActiveLines;
+	while (lines) {
+		line = 31 - __CLZ(lines);
+		lines &= ~(1 << line);
+		lineGuards[line].tokens = STORM_BUCKET;
+	}
+	if (stormActiveLines) {
+		stormActiveLines = 0;
+		Tick_Release(TICK_STORM);
+	}
+	__set_PRIMASK(primask);
+	return 1;
+}
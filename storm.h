@@ -0,0 +1,38 @@
+/*
+ * storm.h
+ *
+ *  Author: Ahmed Talaat (aa_talaat@yahoo.com)
+ */
+
+#ifndef STORM_H_
+#define STORM_H_
+
+#include "gpio.h"
+#include "queues.h"
+
+#define STORM_BUCKET			64			// tokens of a line: edges it may take in a burst
+#define STORM_EDGE_COST			1			// tokens taken by a bounce edge, during a debounce window
+#define STORM_WINDOW_COST		4			// tokens taken by the edge that starts a debounce window (TIM4 + decoding)
+#define STORM_REFILL_MS			1			// one token given back every STORM_REFILL_MS while the tick runs
+#define STORM_BACKOFF_MS		100			// first quarantine of a line, doubled at every new quarantine...
+#define STORM_BACKOFF_MAX_MS	12800		// ...up to this (below 32768 for the tickMs comparisons)
+
+/*
+ * Rate limiting state of one EXTI line
+ */
+typedef struct lineGuard_s {
+	uint8_t		tokens;						// 0 to STORM_BUCKET
+	uint16_t	backoffMs;					// last quarantine length, 0 once the line behaved for as long after it
+	uint16_t	deadline;					// tickMs at the end of the quarantine, then of the probation
+	uint16_t	faults;						// quarantines of the line (saturated)
+} lineGuard_t;
+
+extern lineGuard_t				lineGuards[16];			// indexed by EXTI line
+extern volatile uint16_t		stormQuarantinedLines;	// EXTI lines kept masked
+
+void Storm_Init(void);
+uint8_t Storm_Charge(uint8_t line, uint8_t cost);
+uint16_t Storm_Tick(void);
+uint8_t Storm_Rest(void);
+
+#endif /* STORM_H_ */
@@ -0,0 +1,55 @@
+/*
+ * tick.c
+ *
+ *  Author: Ahmed Talaat (aa_talaat@yahoo.com)
+ *
+ * 1 ms time base shared by the modules that need one: SysTick runs only while at least one user (TICK_xxx) requested
+ * it, so the main loop can still go to STOP mode when nobody does. tickMs keeps its value while SysTick is stopped, and
+ * the users only compare tickMs values taken while they held the tick.
+ *
+ * The users are requested from the main loop and from the EXTI ISRs, hence the critical sections.
+ */
+
+#include "stm32f10x.h"
+#include "tick.h"
+
+volatile uint16_t	tickMs;
+
+static volatile uint8_t	tickUsers;
+
+/*
+ * Start SysTick at 1 ms for a user, if not already running
+ */
+void Tick_Request(uint8_t user) {
+	uint32_t	primask;
+
+	primask = __get_PRIMASK();
+	__disable_irq();
+	if (tickUsers == 0) {
+		SysTick_Config(SystemCoreClock / 1000);
+	}
+	tickUsers |= user;
+	__set_PRIMASK(primask);
+}
+
+/*
+ * Stop SysTick once the last user released it
+ */
+void Tick_Release(uint8_t user) {
+	uint32_t	primask;
+
+	primask = __get_PRIMASK();
+	__disable_irq();
+	tickUsers &= ~user;
+	if (tickUsers == 0) {
+		SysTick->CTRL &= ~SysTick_CTRL_ENABLE_Msk;
+	}
+	__set_PRIMASK(primask);
+}
+
+/*
+ * TICK_xxx users holding the tick
+ */
+uint8_t Tick_Users(void) {
+	return tickUsers;
+}
@@ -0,0 +1,18 @@
+/*
+ * tick.h
+ *
+ *  Author: Ahmed Talaat (aa_talaat@yahoo.com)
+ */
+
+#ifndef TICK_H_
+#define TICK_H_
+
+#define TICK_STORM			0x02		// an EXTI line is rate limited or quarantined (storm.c)
+
+extern volatile uint16_t	tickMs;		// ms, counted by SysTick while it runs
+
+void Tick_Request(uint8_t user);
+void Tick_Release(uint8_t user);
+uint8_t Tick_Users(void);
+
+#endif /* TICK_H_ */
@@ -0,0 +1,166 @@
+/*
+ * uart.c
+ *
+ *  Author: Ahmed Talaat (aa_talaat@yahoo.com)
+ *
+ * Streams the keypad events to a host over USART1 (TX on PA9) using DMA1 channel 4.
+ *
+ * Two frame buffers are used. While the DMA is sending one of them, the main loop appends new events to the other one.
+ * When the DMA transfer completes, the DMA ISR closes the frame being filled and starts sending it right away, so:
+ *	- A single event on an idle link is sent immediately in its own frame (lowest latency).
+ *	- Under load, all the events that arrive while a frame is on the wire are coalesced into the next frame, which keeps
+ *	  the link busy without the CPU ever waiting on the TXE flag.
+ *	- If the frame being filled is full while the DMA is still busy, the event is dropped and counted in
+ *	  uartDroppedEvents rather than blocking the main loop.
+ */
+
+#include "stm32f10x.h"
+#include "uart.h"
+#include "frame.h"
+#include "gpio.h"
+#include "dispatch.h"
+
+uint16_t	uartDroppedEvents = 0;
+
+static frameBuffer_t		txFrames[2];
+static volatile uint8_t		fillIndex = 0;		// index of the frame being filled by the main loop
+static volatile uint8_t		dmaBusy = 0;		// a frame is being sent by the DMA
+static uint8_t				txSeq = 0;
+
+static void startFrameTransfer(void);
+
+/*
+ * Configure USART1 as transmitter only, 8N1, and its DMA channel. The DMA is started for every frame in
+ * startFrameTransfer().
+ */
+void UART_Configuration(void) {
+	USART_InitTypeDef	USART_InitStructure;
+	DMA_InitTypeDef		DMA_InitStructure;
+	NVIC_InitTypeDef	NVIC_InitStructure;
+
+	RCC_AHBPeriphClockCmd(RCC_AHBPeriph_DMA1, ENABLE);
+	RCC_APB2PeriphClockCmd(RCC_APB2Periph_USART1, ENABLE);
+
+	GPIO_ConfigUART();
+
+	USART_InitStructure.USART_BaudRate = UART_BAUDRATE;
+	USART_InitStructure.USART_WordLength = USART_WordLength_8b;
+	USART_InitStructure.USART_StopBits = USART_StopBits_1;
+	USART_InitStructure.USART_Parity = USART_Parity_No;
+	USART_InitStructure.USART_HardwareFlowControl = USART_HardwareFlowControl_None;
+	USART_InitStructure.USART_Mode = USART_Mode_Tx;
+	USART_Init(USART1, &USART_InitStructure);
+
+	DMA_DeInit(DMA1_Channel4);
+	DMA_InitStructure.DMA_PeripheralBaseAddr = (uint32_t) (uintptr_t) &USART1->DR;
+	DMA_InitStructure.DMA_MemoryBaseAddr = (uint32_t) (uintptr_t) txFrames[0].data;
+	DMA_InitStructure.DMA_DIR = DMA_DIR_PeripheralDST;
+	DMA_InitStructure.DMA_BufferSize = 0;
+	DMA_InitStructure.DMA_PeripheralInc = DMA_PeripheralInc_Disable;
+	DMA_InitStructure.DMA_MemoryInc = DMA_MemoryInc_Enable;
+	DMA_InitStructure.DMA_PeripheralDataSize = DMA_PeripheralDataSize_Byte;
+	DMA_InitStructure.DMA_MemoryDataSize = DMA_MemoryDataSize_Byte;
+	DMA_InitStructure.DMA_Mode = DMA_Mode_Normal;
+	DMA_InitStructure.DMA_Priority = DMA_Priority_Low;
+	DMA_InitStructure.DMA_M2M = DMA_M2M_Disable;
+	DMA_Init(DMA1_Channel4, &DMA_InitStructure);
+	DMA_ITConfig(DMA1_Channel4, DMA_IT_TC, ENABLE);
+
+	/* The DMA ISR only swaps buffers, keep it below the debounce timer */
+	NVIC_InitStructure.NVIC_IRQChannel = DMA1_Channel4_IRQn;
+	NVIC_InitStructure.NVIC_IRQChannelPreemptionPriority = 1;
+	NVIC_InitStructure.NVIC_IRQChannelSubPriority = 0;
+	NVIC_InitStructure.NVIC_IRQChannelCmd = ENABLE;
+	NVIC_Init(&NVIC_InitStructure);
+
+	USART_DMACmd(USART1, USART_DMAReq_Tx, ENABLE);
+	USART_Cmd(USART1, ENABLE);
+
+	fillIndex = 0;
+	dmaBusy = 0;
+	initializeFrame(&txFrames[0]);
+	initializeFrame(&txFrames[1]);
+}
+
+/*
+ * Called from the main loop for every event to forward to the host. Returns 0xFF if the event was dropped, 1 otherwise.
+ * Only the DMA interrupt is masked while the frame buffers are updated, the keypad interrupts are not delayed.
+ */
+uint8_t UART_PostEvent(msgQueueDef *theEvent) {
+	uint8_t	rc;
+
+	NVIC_DisableIRQ(DMA1_Channel4_IRQn);
+
+	rc = putEventInFrame(&txFrames[fillIndex], theEvent->msgID, theEvent->deviceID, theEvent->msgContent);
+	if (rc == 0xFF) {
+		uartDroppedEvents++;
+	} else if (!dmaBusy) {
+		startFrameTransfer();					// link is idle, send right away
+	}
+
+	NVIC_EnableIRQ(DMA1_Channel4_IRQn);
+	return rc;
+}
+
+/*
+ * Message handler forwarding every message to the host
+ */
+uint8_t UART_OnEvent(msgQueueDef *theMsg) {
+	UART_PostEvent(theMsg);
+	return DISPATCH_CONTINUE;
+}
+
+/*
+ * Called by the DMA ISR once a frame has been handed over to the USART. Sends the events collected meanwhile, if any.
+ */
+void UART_TxComplete(void) {
+	DMA_Cmd(DMA1_Channel4, DISABLE);
+	dmaBusy = 0;
+	if (txFrames[fillIndex].nEvents) {
+		startFrameTransfer();
+	}
+}
+
+/*
+ * Returns 1 when nothing is queued or being shifted out of the USART
+ */
+uint8_t UART_IsIdle(void) {
+	return (!dmaBusy && (USART_GetFlagStatus(USART1, USART_FLAG_TC) != RESET));
+}
+
+/*
+ * Wait, sleeping between DMA interrupts, until all the frames are sent. To be called before entering STOP mode as the
+ * USART and DMA clocks are stopped there. Once the last DMA transfer is over, at most one character is left in the
+ * shift register.
+ * dmaBusy is tested with the interrupts masked: a DMA interrupt between the test and WFI would otherwise leave the
+ * core asleep until the next key. WFI still wakes up on a masked pending interrupt, which runs once PRIMASK is cleared.
+ */
+void UART_WaitIdle(void) {
+	__disable_irq();
+	while (dmaBusy) {
+		__WFI();
+		__enable_irq();
+		__disable_irq();
+	}
+	__enable_irq();
+	while (USART_GetFlagStatus(USART1, USART_FLAG_TC) == RESET) {}
+}
+
+/*
+ * Close the frame being filled, send it, and switch the main loop to the other buffer.
+ * Must be called with the DMA idle and its interrupt masked (or from the DMA ISR).
+ */
+static void startFrameTransfer(void) {
+	uint8_t	length;
+
+	length = sealFrame(&txFrames[fillIndex], txSeq++);
+
+	DMA1_Channel4->CMAR = (uint32_t) (uintptr_t) txFrames[fillIndex].data;
+	DMA_SetCurrDataCounter(DMA1_Channel4, length);
+	dmaBusy = 1;
+
+	fillIndex ^= 1;
+	initializeFrame(&txFrames[fillIndex]);
+
+	DMA_Cmd(DMA1_Channel4, ENABLE);
+}
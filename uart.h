@@ -0,0 +1,23 @@
+/*
+ * uart.h
+ *
+ *  Author: Ahmed Talaat (aa_talaat@yahoo.com)
+ */
+
+#ifndef UART_H_
+#define UART_H_
+
+#include "queues.h"
+
+#define UART_BAUDRATE		115200
+
+extern uint16_t	uartDroppedEvents;		// events lost because both frame buffers were full
+
+void UART_Configuration(void);
+uint8_t UART_PostEvent(msgQueueDef *theEvent);
+uint8_t UART_OnEvent(msgQueueDef *theMsg);
+void UART_TxComplete(void);
+uint8_t UART_IsIdle(void);
+void UART_WaitIdle(void);
+
+#endif /* UART_H_ */
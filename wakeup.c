@@ -0,0 +1,102 @@
+/*
+ * wakeup.c
+ *
+ *  Author: Ahmed Talaat (aa_talaat@yahoo.com)
+ *
+ * Time base of the waits that outlast a key press, e.g. the timeouts of the flows: the RTC counts ms from the LSI and
+ * keeps counting in STOP mode, and its alarm wakes the device up through EXTI line 17. Unlike SysTick (tick.c), it
+ * lets the main loop enter STOP mode while a wait is pending, at the cost of the LSI accuracy: a ms of the RTC lasts
+ * 0.67 to 1.33 ms.
+ *
+ * There is one alarm, owned by the flow engine (flow.c). Cancelling it leaves the RTC alarm register as is, as writing
+ * it costs a wait: an alarm left over wakes the device up once more, and the main loop goes back to STOP mode at once.
+ * The RTC registers are only reliable once resynchronized with the APB1 clock after STOP mode, and a write takes 3 LSI
+ * cycles: Wakeup_Now() and Wakeup_Set() wait up to 100 us, they are called from the main loop when a flow waits, never
+ * from the ISRs.
+ */
+
+#include "stm32f10x.h"
+#include "wakeup.h"
+
+volatile uint8_t	wakeupDue;
+
+/*
+ * Run the RTC from the LSI at 1 kHz, and route its alarm to the RTCAlarm interrupt (EXTI line 17), lowest priority
+ */
+void Wakeup_Init(void) {
+	EXTI_InitTypeDef	EXTI_InitStructure;
+	NVIC_InitTypeDef	NVIC_InitStructure;
+
+	RCC_APB1PeriphClockCmd(RCC_APB1Periph_PWR | RCC_APB1Periph_BKP, ENABLE);
+	PWR_BackupAccessCmd(ENABLE);				// the RTC is in the backup domain
+
+	RCC_LSICmd(ENABLE);
+	while (RCC_GetFlagStatus(RCC_FLAG_LSIRDY) == RESET) {}
+	RCC_RTCCLKConfig(RCC_RTCCLKSource_LSI);
+	RCC_RTCCLKCmd(ENABLE);
+
+	RTC_WaitForSynchro();
+	RTC_WaitForLastTask();
+	RTC_SetPrescaler(WAKEUP_LSI_HZ / 1000 - 1);
+	RTC_WaitForLastTask();
+	RTC_ClearFlag(RTC_FLAG_ALR);
+	wakeupDue = 0;
+
+	EXTI_ClearITPendingBit(EXTI_Line17);
+	EXTI_InitStructure.EXTI_Line = EXTI_Line17;
+	EXTI_InitStructure.EXTI_Mode = EXTI_Mode_Interrupt;
+	EXTI_InitStructure.EXTI_Trigger = EXTI_Trigger_Rising;
+	EXTI_InitStructure.EXTI_LineCmd = ENABLE;
+	EXTI_Init(&EXTI_InitStructure);
+
+	NVIC_InitStructure.NVIC_IRQChannel = RTCAlarm_IRQn;
+	NVIC_InitStructure.NVIC_IRQChannelPreemptionPriority = 0x0F;
+	NVIC_InitStructure.NVIC_IRQChannelSubPriority = 0x0F;
+	NVIC_InitStructure.NVIC_IRQChannelCmd = ENABLE;
+	NVIC_Init(&NVIC_InitStructure);
+}
+
+/*
+ * RTC counter, in ms. The values only compare within 32 s of each other.
+ */
+uint16_t Wakeup_Now(void) {
+	RTC_WaitForSynchro();
+	return (uint16_t) RTC_GetCounter();
+}
+
+/*
+ * Raise wakeupDue when the counter reaches at, a Wakeup_Now() value. A date already reached, or too close to be set
+ * before the counter passes it, raises it at once.
+ */
+void Wakeup_Set(uint16_t at) {
+	uint32_t	now;
+	int16_t		delta;
+
+	RTC_WaitForSynchro();
+	now = RTC_GetCounter();
+	delta = (int16_t) (at - (uint16_t) now);
+	if (delta < 2) {
+		Wakeup_Cancel();
+		wakeupDue = 1;
+		return;
+	}
+	RTC_WaitForLastTask();
+	RTC_SetAlarm(now + delta);
+	RTC_WaitForLastTask();
+}
+
+/*
+ * No wait pending anymore
+ */
+void Wakeup_Cancel(void) {
+	wakeupDue = 0;
+}
+
+/*
+ * Called by RTCAlarm_IRQHandler
+ */
+void Wakeup_Alarm(void) {
+	EXTI_ClearITPendingBit(EXTI_Line17);
+	RTC_ClearFlag(RTC_FLAG_ALR);
+	wakeupDue = 1;
+}
@@ -0,0 +1,20 @@
+/*
+ * wakeup.h
+ *
+ *  Author: Ahmed Talaat (aa_talaat@yahoo.com)
+ */
+
+#ifndef WAKEUP_H_
+#define WAKEUP_H_
+
+#define WAKEUP_LSI_HZ		40000		// nominal LSI frequency, 30 to 60 kHz over the devices and temperatures
+
+extern volatile uint8_t	wakeupDue;		// set by the alarm, cleared by the main loop once handled
+
+void Wakeup_Init(void);
+uint16_t Wakeup_Now(void);
+void Wakeup_Set(uint16_t at);
+void Wakeup_Cancel(void);
+void Wakeup_Alarm(void);
+
+#endif /* WAKEUP_H_ */